@@ -0,0 +1,202 @@
+/*
+MIT License
+
+Copyright (c) 2023 erysdren (it/she/they)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ *
+ * headers
+ *
+ */
+
+/* std */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* atlas */
+#include "atlas.h"
+
+/*
+ *
+ * macros
+ *
+ */
+
+/* smallest layer worth packing into */
+#define ATLAS_MIN_SIZE 256
+
+/*
+ *
+ * types
+ *
+ */
+
+/* rect waiting to be packed */
+typedef struct
+{
+	int height;
+	int index;
+} atlas_order_t;
+
+/*
+ *
+ * functions
+ *
+ */
+
+/*
+ * atlas_compare
+ */
+
+static int atlas_compare(const void *a, const void *b)
+{
+	const atlas_order_t *oa = (const atlas_order_t *)a;
+	const atlas_order_t *ob = (const atlas_order_t *)b;
+
+	/* tallest first, then in input order */
+	if (oa->height != ob->height)
+		return ob->height - oa->height;
+
+	return oa->index - ob->index;
+}
+
+/*
+ * atlas_pack
+ */
+
+atlas_t *atlas_pack(const int *widths, const int *heights, int num_rects, int max_size)
+{
+	/* variables */
+	atlas_t *atlas;
+	atlas_order_t *order;
+	int size, largest = 1;
+	int shelf_x = 0, shelf_y = 0, shelf_height = 0;
+	int i;
+
+	/* layers are square and fit the biggest rect */
+	for (i = 0; i < num_rects; i++)
+	{
+		if (widths[i] <= 0 || heights[i] <= 0)
+		{
+			printf("error: empty atlas rect %d\n", i);
+			return NULL;
+		}
+		if (widths[i] > largest) largest = widths[i];
+		if (heights[i] > largest) largest = heights[i];
+	}
+
+	size = ATLAS_MIN_SIZE;
+	while (size < largest)
+		size *= 2;
+	if (size > max_size)
+		size = max_size;
+	if (size < largest)
+	{
+		printf("error: %dpx texture doesn't fit in a %dpx layer\n", largest, max_size);
+		return NULL;
+	}
+
+	/* alloc */
+	atlas = calloc(1, sizeof(atlas_t));
+	order = malloc((num_rects + 1) * sizeof(atlas_order_t));
+	if (atlas == NULL || order == NULL)
+	{
+		printf("error: failed malloc\n");
+		free(atlas);
+		free(order);
+		return NULL;
+	}
+
+	atlas->rects = calloc(num_rects + 1, sizeof(atlas_rect_t));
+	if (atlas->rects == NULL)
+	{
+		printf("error: failed malloc\n");
+		free(atlas);
+		free(order);
+		return NULL;
+	}
+
+	atlas->width = size;
+	atlas->height = size;
+	atlas->num_rects = num_rects;
+	atlas->num_layers = num_rects ? 1 : 0;
+
+	/* tallest first keeps the shelves tight */
+	for (i = 0; i < num_rects; i++)
+	{
+		order[i].height = heights[i];
+		order[i].index = i;
+	}
+	qsort(order, num_rects, sizeof(atlas_order_t), atlas_compare);
+
+	/* next fit shelves */
+	for (i = 0; i < num_rects; i++)
+	{
+		atlas_rect_t *rect = &atlas->rects[order[i].index];
+
+		rect->width = widths[order[i].index];
+		rect->height = heights[order[i].index];
+
+		/* new shelf */
+		if (shelf_x + rect->width > size)
+		{
+			shelf_y += shelf_height;
+			shelf_x = 0;
+			shelf_height = 0;
+		}
+
+		/* new layer */
+		if (shelf_y + rect->height > size)
+		{
+			atlas->num_layers++;
+			shelf_x = 0;
+			shelf_y = 0;
+			shelf_height = 0;
+		}
+
+		rect->layer = atlas->num_layers - 1;
+		rect->x = shelf_x;
+		rect->y = shelf_y;
+
+		shelf_x += rect->width;
+		if (rect->height > shelf_height)
+			shelf_height = rect->height;
+	}
+
+	free(order);
+
+	return atlas;
+}
+
+/*
+ * atlas_free
+ */
+
+void atlas_free(atlas_t *atlas)
+{
+	if (atlas)
+	{
+		if (atlas->rects) free(atlas->rects);
+		free(atlas);
+	}
+}
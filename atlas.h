@@ -0,0 +1,50 @@
+/*
+MIT License
+
+Copyright (c) 2023 erysdren (it/she/they)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _ATLAS_H_
+#define _ATLAS_H_
+
+/* packed rect, in pixels */
+typedef struct
+{
+	int layer;
+	int x, y;
+	int width, height;
+} atlas_rect_t;
+
+/* layers of equal size, each holding a set of shelves */
+typedef struct
+{
+	int width;
+	int height;
+	int num_layers;
+	atlas_rect_t *rects;
+	int num_rects;
+} atlas_t;
+
+/* function prototypes */
+atlas_t *atlas_pack(const int *widths, const int *heights, int num_rects, int max_size);
+void atlas_free(atlas_t *atlas);
+
+#endif /* _ATLAS_H_ */
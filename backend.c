@@ -35,11 +35,13 @@ SOFTWARE.
 #include <float.h>
 #include <math.h>
 #include <string.h>
+#include <stddef.h>
 #include <stdbool.h>
 
 /* sdl2 */
+#define GL_GLEXT_PROTOTYPES
 #include <SDL.h>
-#include <SDL_opengles2.h>
+#include <SDL_opengl.h>
 
 /* gl */
 #include <GL/gl.h>
@@ -69,6 +71,76 @@ vec3_t m_speedkey;
 vec2_t mouse;
 vec3i_t mb;
 
+/* core renderer */
+int gl_renderer = RENDERER_LEGACY;
+GLuint gl_program;
+GLuint gl_program_array;
+GLuint gl_program_indexed;
+GLuint gl_program_array_indexed;
+GLuint gl_camera;
+
+/* core renderer shaders, INDEXED looks texels up in the palette */
+static const char *vertex_shader =
+	"layout(std140) uniform camera { mat4 projection; mat4 view; };\n"
+	"layout(location = 0) in vec3 position;\n"
+	"layout(location = 1) in vec2 texcoord;\n"
+	"out vec2 uv;\n"
+	"void main()\n"
+	"{\n"
+	"	uv = texcoord;\n"
+	"	gl_Position = projection * view * vec4(position, 1.0);\n"
+	"}\n";
+
+static const char *fragment_shader =
+	"uniform sampler2D tex;\n"
+	"uniform sampler2D palette;\n"
+	"in vec2 uv;\n"
+	"out vec4 color;\n"
+	"void main()\n"
+	"{\n"
+	"#ifdef INDEXED\n"
+	"	color = texelFetch(palette, ivec2(int(texture(tex, uv).r * 255.0 + 0.5), 0), 0);\n"
+	"#else\n"
+	"	color = texture(tex, uv);\n"
+	"#endif\n"
+	"}\n";
+
+/* texture array shaders, repeating each texture inside its rect */
+static const char *vertex_shader_array =
+	"layout(std140) uniform camera { mat4 projection; mat4 view; };\n"
+	"layout(location = 0) in vec3 position;\n"
+	"layout(location = 1) in vec2 texcoord;\n"
+	"layout(location = 2) in vec4 rect;\n"
+	"layout(location = 3) in float layer;\n"
+	"out vec2 uv;\n"
+	"flat out vec4 uv_rect;\n"
+	"flat out float uv_layer;\n"
+	"void main()\n"
+	"{\n"
+	"	uv = texcoord;\n"
+	"	uv_rect = rect;\n"
+	"	uv_layer = layer;\n"
+	"	gl_Position = projection * view * vec4(position, 1.0);\n"
+	"}\n";
+
+static const char *fragment_shader_array =
+	"uniform sampler2DArray tex;\n"
+	"uniform sampler2D palette;\n"
+	"in vec2 uv;\n"
+	"flat in vec4 uv_rect;\n"
+	"flat in float uv_layer;\n"
+	"out vec4 color;\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 st = uv_rect.xy + fract(uv) * uv_rect.zw;\n"
+	"	vec4 texel = textureGrad(tex, vec3(st, uv_layer), dFdx(uv) * uv_rect.zw, dFdy(uv) * uv_rect.zw);\n"
+	"#ifdef INDEXED\n"
+	"	color = texelFetch(palette, ivec2(int(texel.r * 255.0 + 0.5), 0), 0);\n"
+	"#else\n"
+	"	color = texel;\n"
+	"#endif\n"
+	"}\n";
+
 /*
  *
  * functions
@@ -126,6 +198,143 @@ float normalize(vec3_t *v)
 	return w;
 }
 
+/*
+ * cross
+ */
+
+static vec3_t cross(vec3_t v1, vec3_t v2)
+{
+	vec3_t result;
+	result.x = v1.y * v2.z - v1.z * v2.y;
+	result.y = v1.z * v2.x - v1.x * v2.z;
+	result.z = v1.x * v2.y - v1.y * v2.x;
+	return result;
+}
+
+/*
+ * perspective
+ */
+
+static void perspective(float m[16], float fovy, float aspect, float znear)
+{
+	/* same as gluPerspective with the far plane at infinity */
+	float f = 1.0f / tanf(DEG2RAD(fovy) / 2);
+
+	memset(m, 0, sizeof(float) * 16);
+	m[0] = f / aspect;
+	m[5] = f;
+	m[10] = -1.0f;
+	m[11] = -1.0f;
+	m[14] = -2.0f * znear;
+}
+
+/*
+ * look_at
+ */
+
+static void look_at(float m[16], vec3_t eye, vec3_t center, vec3_t up)
+{
+	/* same as gluLookAt */
+	vec3_t f, s, u;
+
+	f.x = center.x - eye.x;
+	f.y = center.y - eye.y;
+	f.z = center.z - eye.z;
+	normalize(&f);
+	s = cross(f, up);
+	normalize(&s);
+	u = cross(s, f);
+
+	m[0] = s.x; m[4] = s.y; m[8] = s.z; m[12] = -dot(s, eye);
+	m[1] = u.x; m[5] = u.y; m[9] = u.z; m[13] = -dot(u, eye);
+	m[2] = -f.x; m[6] = -f.y; m[10] = -f.z; m[14] = dot(f, eye);
+	m[3] = 0; m[7] = 0; m[11] = 0; m[15] = 1;
+}
+
+/*
+ * compile_shader
+ */
+
+static GLuint compile_shader(GLenum type, const char *defines, const char *source)
+{
+	GLuint shader;
+	GLint status;
+	char log[1024];
+	const char *sources[3];
+
+	/* the version has to come first */
+	sources[0] = "#version 330 core\n";
+	sources[1] = defines;
+	sources[2] = source;
+
+	shader = glCreateShader(type);
+	glShaderSource(shader, 3, sources, NULL);
+	glCompileShader(shader);
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (!status)
+	{
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		error("couldn't compile shader: %s", log);
+	}
+
+	return shader;
+}
+
+/*
+ * link_program
+ */
+
+static GLuint link_program(const char *vertex, const char *fragment, const char *defines)
+{
+	GLuint program, vs, fs;
+	GLint status;
+	char log[1024];
+
+	vs = compile_shader(GL_VERTEX_SHADER, defines, vertex);
+	fs = compile_shader(GL_FRAGMENT_SHADER, defines, fragment);
+	program = glCreateProgram();
+	glAttachShader(program, vs);
+	glAttachShader(program, fs);
+	glLinkProgram(program);
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (!status)
+	{
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		error("couldn't link program: %s", log);
+	}
+
+	/* texture unit 0, palette unit 1, camera block 0 */
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "tex"), 0);
+	glUniform1i(glGetUniformLocation(program, "palette"), 1);
+	glUniformBlockBinding(program, glGetUniformBlockIndex(program, "camera"), 0);
+
+	return program;
+}
+
+/*
+ * init_core
+ */
+
+static bool init_core(void)
+{
+	/* programs */
+	gl_program = link_program(vertex_shader, fragment_shader, "");
+	gl_program_array = link_program(vertex_shader_array, fragment_shader_array, "");
+	gl_program_indexed = link_program(vertex_shader, fragment_shader, "#define INDEXED\n");
+	gl_program_array_indexed = link_program(vertex_shader_array, fragment_shader_array, "#define INDEXED\n");
+
+	/* camera matrices */
+	glGenBuffers(1, &gl_camera);
+	glBindBuffer(GL_UNIFORM_BUFFER, gl_camera);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(float) * 32, NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 0, gl_camera);
+
+	return true;
+}
+
 /*
  * camera
  */
@@ -206,11 +415,6 @@ void camera(float speed, float hfov)
 	aspect = (float)w / (float)h;
 	vfov = 2 * atanf(tanf(DEG2RAD(hfov) / 2) * (float)h / (float)w);
 
-	/* set perspective */
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	gluPerspective(ceilf(RAD2DEG(vfov)), aspect, 1, FLT_MAX);
-
 	/* set camera view */
 	m_look.x = cosf(DEG2RAD(m_rot.y)) * cosf(DEG2RAD(m_rot.x));
 	m_look.y = sinf(DEG2RAD(m_rot.x));
@@ -218,6 +422,32 @@ void camera(float speed, float hfov)
 	m_strafe.x = cosf(DEG2RAD(m_rot.y) - M_PI_2);
 	m_strafe.z = sinf(DEG2RAD(m_rot.y) - M_PI_2);
 
+	/* core renderer keeps its matrices in a uniform buffer */
+	if (gl_renderer == RENDERER_CORE)
+	{
+		float matrices[32];
+		vec3_t center, up;
+
+		center.x = m_pos.x + m_look.x;
+		center.y = m_pos.y + m_look.y;
+		center.z = m_pos.z + m_look.z;
+		up.x = 0.0f;
+		up.y = 1.0f;
+		up.z = 0.0f;
+
+		perspective(&matrices[0], ceilf(RAD2DEG(vfov)), aspect, 1);
+		look_at(&matrices[16], m_pos, center, up);
+
+		glBindBuffer(GL_UNIFORM_BUFFER, gl_camera);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(matrices), matrices);
+		return;
+	}
+
+	/* set perspective */
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	gluPerspective(ceilf(RAD2DEG(vfov)), aspect, 1, FLT_MAX);
+
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();
 	gluLookAt(m_pos.x, m_pos.y, m_pos.z, m_pos.x + m_look.x,
@@ -296,7 +526,7 @@ bool frame(void)
  * init
  */
 
-bool init(int w, int h, char *title)
+bool init(int w, int h, char *title, int renderer)
 {
 	/* sdl */
 	SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS);
@@ -304,9 +534,19 @@ bool init(int w, int h, char *title)
 	if (window == NULL) return false;
 
 	/* gl */
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 1);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_COMPATIBILITY);
+	gl_renderer = renderer;
+	if (renderer == RENDERER_CORE)
+	{
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+	}
+	else
+	{
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 1);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_COMPATIBILITY);
+	}
 	context = SDL_GL_CreateContext(window);
 	if (context == NULL) return false;
 
@@ -316,7 +556,15 @@ bool init(int w, int h, char *title)
 	/* enable gl features */
 	glEnable(GL_CULL_FACE);
 	glEnable(GL_DEPTH_TEST);
-	glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST);
+	if (renderer == RENDERER_CORE)
+	{
+		if (!init_core()) return false;
+	}
+	else
+	{
+		glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST);
+		glShadeModel(GL_FLAT);
+	}
 
 	/* exit gracefully */
 	return true;
@@ -328,6 +576,15 @@ bool init(int w, int h, char *title)
 
 void quit(void)
 {
+	if (gl_renderer == RENDERER_CORE)
+	{
+		glDeleteBuffers(1, &gl_camera);
+		glDeleteProgram(gl_program);
+		glDeleteProgram(gl_program_array);
+		glDeleteProgram(gl_program_indexed);
+		glDeleteProgram(gl_program_array_indexed);
+	}
+
 	SDL_DestroyWindow(window);
 	SDL_GL_DeleteContext(context);
 	SDL_Quit();
@@ -351,6 +608,119 @@ void *zalloc(size_t size)
 	return calloc(1, size);
 }
 
+/*
+ * interleave_mesh
+ */
+
+static gl_vertex_t *interleave_mesh(gl_mesh_t *mesh)
+{
+	gl_vertex_t *vertices;
+	int i, j, k;
+
+	vertices = calloc(mesh->num_vertices + 1, sizeof(gl_vertex_t));
+	if (vertices == NULL)
+		return NULL;
+
+	if (mesh->interleaved)
+	{
+		memcpy(vertices, mesh->interleaved, mesh->num_vertices * sizeof(gl_vertex_t));
+	}
+	else
+	{
+		for (i = 0; i < mesh->num_vertices; i++)
+		{
+			vertices[i].position = mesh->vertices[i];
+			vertices[i].texcoord = mesh->texcoords[i];
+		}
+	}
+
+	/* vertices belong to one texture each, so they can carry its rect */
+	for (i = 0; i < mesh->num_textures; i++)
+	{
+		gl_texture_t *texture = &mesh->textures[i];
+
+		for (j = texture->first_triangle; j < texture->first_triangle + texture->num_triangles; j++)
+		{
+			int *triangle = &mesh->triangles[j].x;
+
+			for (k = 0; k < 3; k++)
+			{
+				memcpy(vertices[triangle[k]].rect, texture->rect, sizeof(texture->rect));
+				vertices[triangle[k]].layer = (float)texture->layer;
+			}
+		}
+	}
+
+	return vertices;
+}
+
+/*
+ * upload_mesh
+ */
+
+bool upload_mesh(gl_mesh_t *mesh)
+{
+	gl_vertex_t *vertices;
+
+	/* prebuilt vertices go up as they are, unless they need atlas rects */
+	if (mesh->interleaved && !mesh->array)
+		vertices = mesh->interleaved;
+	else if ((vertices = interleave_mesh(mesh)) == NULL)
+		return false;
+
+	/* vertex buffer */
+	glGenBuffers(1, &mesh->vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+	glBufferData(GL_ARRAY_BUFFER, mesh->num_vertices * sizeof(gl_vertex_t), vertices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	/* index buffer, triangles are three ints each */
+	glGenBuffers(1, &mesh->ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->num_triangles * sizeof(vec3i_t), mesh->triangles, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	if (vertices != mesh->interleaved)
+		free(vertices);
+
+	/* core renderer records the layout in a vertex array */
+	if (gl_renderer == RENDERER_CORE)
+	{
+		glGenVertexArrays(1, &mesh->vao);
+		glBindVertexArray(mesh->vao);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ibo);
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glEnableVertexAttribArray(2);
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(gl_vertex_t), (void *)offsetof(gl_vertex_t, position));
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(gl_vertex_t), (void *)offsetof(gl_vertex_t, texcoord));
+		glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(gl_vertex_t), (void *)offsetof(gl_vertex_t, rect));
+		glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(gl_vertex_t), (void *)offsetof(gl_vertex_t, layer));
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	return true;
+}
+
+/*
+ * unload_mesh
+ */
+
+void unload_mesh(gl_mesh_t *mesh)
+{
+	if (mesh->vbo) glDeleteBuffers(1, &mesh->vbo);
+	if (mesh->ibo) glDeleteBuffers(1, &mesh->ibo);
+	if (mesh->vao) glDeleteVertexArrays(1, &mesh->vao);
+	if (mesh->array) glDeleteTextures(1, &mesh->array);
+	mesh->array = 0;
+	mesh->vbo = 0;
+	mesh->ibo = 0;
+	mesh->vao = 0;
+}
+
 /*
  * draw_mesh
  */
@@ -359,20 +729,76 @@ void draw_mesh(gl_mesh_t *mesh)
 {
 	int i;
 
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
+	/* upload on first use */
+	if (!mesh->vbo && !upload_mesh(mesh))
+		return;
 
+	/* indexed textures need their palette on unit 1 */
+	if (gl_renderer == RENDERER_CORE && mesh->palette)
+	{
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, mesh->palette);
+	}
+
+	/* everything in one texture array, one draw */
+	if (gl_renderer == RENDERER_CORE && mesh->array)
+	{
+		glUseProgram(mesh->palette ? gl_program_array_indexed : gl_program_array);
+		glBindVertexArray(mesh->vao);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, mesh->array);
+		glDrawElements(GL_TRIANGLES, mesh->num_triangles * 3, GL_UNSIGNED_INT, NULL);
+		glBindVertexArray(0);
+		return;
+	}
+
+	/* core renderer */
+	if (gl_renderer == RENDERER_CORE)
+	{
+		glUseProgram(mesh->palette ? gl_program_indexed : gl_program);
+		glBindVertexArray(mesh->vao);
+		glActiveTexture(GL_TEXTURE0);
+
+		for (i = 0; i < mesh->num_textures; i++)
+		{
+			if (!mesh->textures[i].num_triangles)
+				continue;
+
+			glBindTexture(GL_TEXTURE_2D, mesh->textures[i].id);
+			glDrawElements(GL_TRIANGLES, mesh->textures[i].num_triangles * 3, GL_UNSIGNED_INT,
+				(void *)(mesh->textures[i].first_triangle * sizeof(vec3i_t)));
+		}
+
+		glBindVertexArray(0);
+		return;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ibo);
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glVertexPointer(3, GL_FLOAT, sizeof(gl_vertex_t), (void *)offsetof(gl_vertex_t, position));
+	glTexCoordPointer(2, GL_FLOAT, sizeof(gl_vertex_t), (void *)offsetof(gl_vertex_t, texcoord));
+
+	glEnable(GL_TEXTURE_2D);
+
+	/* one draw per texture */
 	for (i = 0; i < mesh->num_textures; i++)
 	{
+		if (!mesh->textures[i].num_triangles)
+			continue;
+
 		glBindTexture(GL_TEXTURE_2D, mesh->textures[i].id);
-		glEnable(GL_TEXTURE_2D);
+		glDrawElements(GL_TRIANGLES, mesh->textures[i].num_triangles * 3, GL_UNSIGNED_INT,
+			(void *)(mesh->textures[i].first_triangle * sizeof(vec3i_t)));
+	}
 
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, mesh->vertices);
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, mesh->texcoords);
+	glDisable(GL_TEXTURE_2D);
 
-		glDisable(GL_TEXTURE_2D);
-	}
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
 
-	glDisableVertexAttribArray(0);
-	glDisableVertexAttribArray(1);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
@@ -32,6 +32,9 @@ SOFTWARE.
 /* gl */
 #include <GL/gl.h>
 
+/* longest texture name, including the terminator */
+#define TEXTURE_NAME_LEN 32
+
 /* vec3 (float) */
 typedef struct
 {
@@ -63,11 +66,25 @@ typedef struct
 	int width;
 	int height;
 	uint8_t *pixels;
-	char name[16];
+	int num_levels;
+	char name[TEXTURE_NAME_LEN];
 	int first_triangle;
 	int num_triangles;
+
+	/* place in the mesh's texture array, x, y, w, h in 0..1 */
+	int layer;
+	float rect[4];
 } gl_texture_t;
 
+/* gl vertex, interleaved for upload */
+typedef struct
+{
+	vec3_t position;
+	vec2_t texcoord;
+	float rect[4];
+	float layer;
+} gl_vertex_t;
+
 /* gl mesh */
 typedef struct
 {
@@ -83,16 +100,34 @@ typedef struct
 	vec2_t *texcoords;
 	int num_texcoords;
 
+	/* prebuilt for upload instead of the arrays above, these and the */
+	/* triangles then belong to whoever built them (not owned) */
+	gl_vertex_t *interleaved;
+
 	/* textures */
 	gl_texture_t *textures;
 	int num_textures;
 
-	/* buffer objects */
-	GLint vbo;
-	GLint ibo;
+	/* buffer objects, 0 until uploaded */
+	GLuint vbo;
+	GLuint ibo;
+	GLuint vao;
+
+	/* texture array holding every texture, 0 to bind them one by one */
+	GLuint array;
+
+	/* palette for 8-bit indexed textures, 0 if they're rgb (not owned) */
+	GLuint palette;
 
 } gl_mesh_t;
 
+/* renderers */
+enum
+{
+	RENDERER_LEGACY,
+	RENDERER_CORE
+};
+
 /* pi */
 #ifndef M_PI
 #define M_PI 3.14159265
@@ -116,10 +151,12 @@ float normalize(vec3_t *v);
 void camera(float speed, float hfov);
 void camera_set_pos(float x, float y, float z);
 bool frame(void);
-bool init(int w, int h, char *title);
+bool init(int w, int h, char *title, int renderer);
 void quit(void);
 bool key(int sc);
 void *zalloc(size_t size);
+bool upload_mesh(gl_mesh_t *mesh);
+void unload_mesh(gl_mesh_t *mesh);
 void draw_mesh(gl_mesh_t *mesh);
 
 #endif /* _BACKEND_H_ */
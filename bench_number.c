@@ -0,0 +1,192 @@
+/*
+MIT License
+
+Copyright (c) 2023 erysdren (it/she/they)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ *
+ * headers
+ *
+ */
+
+/* posix */
+#define _POSIX_C_SOURCE 200809L
+
+/* std */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* glprey */
+#include "number.h"
+
+/*
+ *
+ * macros
+ *
+ */
+
+/* longest token generated */
+#define TOKEN_LEN 32
+
+/*
+ *
+ * globals
+ *
+ */
+
+/* formats the bsp files use, and a few longer ones */
+const char *float_formats[] = {"%0.6f", "%0.3f", "%.9f", "%.17g"};
+#define NUM_FLOAT_FORMATS ((int)(sizeof(float_formats) / sizeof(float_formats[0])))
+
+/* keeps the results alive */
+volatile double sink_double;
+volatile int sink_int;
+
+/*
+ *
+ * functions
+ *
+ */
+
+/*
+ * now
+ */
+
+double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * random_double
+ */
+
+double random_double(void)
+{
+	double v = (double)rand() / RAND_MAX * 2.0 - 1.0;
+
+	/* mostly map coordinates, a few smaller and bigger */
+	switch (rand() % 4)
+	{
+		case 0: return v;
+		case 1: return v * 100.0;
+		case 2: return v * 10000.0;
+		default: return v * 1000000.0;
+	}
+}
+
+/*
+ * main
+ */
+
+int main(int argc, char *argv[])
+{
+	/* variables */
+	char *tokens;
+	int *lens;
+	int i, n = 4000000;
+	int mismatches = 0;
+	double start, t_atof, t_strtod, t_number_double, t_atoi, t_number_int, sum;
+
+	if (argc > 1)
+		n = atoi(argv[1]);
+	if (n <= 0)
+		return 1;
+
+	tokens = malloc((size_t)n * TOKEN_LEN);
+	lens = malloc((size_t)n * sizeof(int));
+	if (tokens == NULL || lens == NULL)
+	{
+		printf("error: failed malloc\n");
+		return 1;
+	}
+
+	/* floats */
+	srand(1);
+	for (i = 0; i < n; i++)
+		lens[i] = snprintf(&tokens[i * TOKEN_LEN], TOKEN_LEN, float_formats[i % NUM_FLOAT_FORMATS], random_double());
+
+	for (i = 0; i < n; i++)
+	{
+		const char *s = &tokens[i * TOKEN_LEN];
+		double a = strtod(s, NULL), b = number_double(s, lens[i]);
+		if (memcmp(&a, &b, sizeof(double)) != 0)
+			mismatches++;
+	}
+
+	start = now();
+	for (i = 0, sum = 0; i < n; i++)
+		sum += atof(&tokens[i * TOKEN_LEN]);
+	t_atof = now() - start;
+	sink_double = sum;
+
+	start = now();
+	for (i = 0, sum = 0; i < n; i++)
+		sum += strtod(&tokens[i * TOKEN_LEN], NULL);
+	t_strtod = now() - start;
+	sink_double = sum;
+
+	start = now();
+	for (i = 0, sum = 0; i < n; i++)
+		sum += number_double(&tokens[i * TOKEN_LEN], lens[i]);
+	t_number_double = now() - start;
+	sink_double = sum;
+
+	/* ints */
+	for (i = 0; i < n; i++)
+		lens[i] = snprintf(&tokens[i * TOKEN_LEN], TOKEN_LEN, "%d", (int)(random_double() * 1000.0));
+
+	for (i = 0; i < n; i++)
+	{
+		const char *s = &tokens[i * TOKEN_LEN];
+		if (atoi(s) != number_int(s, lens[i]))
+			mismatches++;
+	}
+
+	start = now();
+	for (i = 0, sink_int = 0; i < n; i++)
+		sink_int += atoi(&tokens[i * TOKEN_LEN]);
+	t_atoi = now() - start;
+
+	start = now();
+	for (i = 0, sink_int = 0; i < n; i++)
+		sink_int += number_int(&tokens[i * TOKEN_LEN], lens[i]);
+	t_number_int = now() - start;
+
+	/* report */
+	printf("%d tokens, %d mismatches against libc\n", n, mismatches);
+	printf("atof          %6.1f ns\n", t_atof * 1e9 / n);
+	printf("strtod        %6.1f ns\n", t_strtod * 1e9 / n);
+	printf("number_double %6.1f ns\n", t_number_double * 1e9 / n);
+	printf("atoi          %6.1f ns\n", t_atoi * 1e9 / n);
+	printf("number_int    %6.1f ns\n", t_number_int * 1e9 / n);
+
+	free(tokens);
+	free(lens);
+
+	return mismatches != 0;
+}
@@ -0,0 +1,229 @@
+/*
+MIT License
+
+Copyright (c) 2023 erysdren (it/she/they)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ *
+ * headers
+ *
+ */
+
+/* posix */
+#define _POSIX_C_SOURCE 200809L
+
+/* std */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* glprey */
+#include "wad.h"
+#include "mip.h"
+#include "palette.h"
+
+/*
+ *
+ * globals
+ *
+ */
+
+/* keeps the results alive */
+volatile uint8_t sink;
+
+/*
+ *
+ * functions
+ *
+ */
+
+/*
+ * now
+ */
+
+double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * expand_plain
+ */
+
+void expand_plain(const palette_t *palette, const uint8_t *src, uint8_t *dst, size_t num_pixels, int channels)
+{
+	size_t i;
+
+	/* the per pixel loop palette_expand replaced */
+	for (i = 0; i < num_pixels; i++)
+		memcpy(&dst[i * channels], &palette->rgba[src[i]], channels);
+}
+
+/*
+ * main
+ */
+
+int main(int argc, char *argv[])
+{
+	/* variables */
+	const char *filename = argc > 1 ? argv[1] : "MACT.WAD";
+	int passes = argc > 2 ? atoi(argv[2]) : 20;
+	wad_t *wad;
+	uint8_t *colors, *dst, *ref;
+	palette_t palette;
+	mip_t **mips;
+	int num_mips = 0;
+	int mismatches = 0;
+	size_t num_pixels = 0, max_pixels = 0;
+	int i, e, p, channels;
+
+	if (passes <= 0)
+		return 1;
+
+	/* open wad */
+	wad = wad_open(filename, WAD_MAP);
+	if (wad == NULL)
+		return 1;
+
+	colors = wad_find(wad, "PAL", NULL);
+	if (colors == NULL)
+	{
+		printf("error: wad does not contain PAL lump\n");
+		wad_free(wad);
+		return 1;
+	}
+	palette_init(&palette, colors, 255);
+
+	/* every miptex, every stored level */
+	mips = malloc((wad->header.num_lumps + 1) * sizeof(mip_t *));
+	if (mips == NULL)
+	{
+		printf("error: failed malloc\n");
+		wad_free(wad);
+		return 1;
+	}
+
+	for (i = 0; i < wad->header.num_lumps; i++)
+	{
+		mip_t *mip;
+
+		if (wad->lumps[i].type != 11)
+			continue;
+
+		mip = mip_view(wad_lump_data(wad, &wad->lumps[i]), wad->lumps[i].len_data);
+		if (mip == NULL)
+			continue;
+
+		for (e = 0; e < mip->header.num_entries; e++)
+		{
+			size_t n = (size_t)mip->entries[e].width * mip->entries[e].height;
+			num_pixels += n;
+			if (n > max_pixels)
+				max_pixels = n;
+		}
+
+		mips[num_mips++] = mip;
+	}
+
+	dst = malloc(max_pixels * 4 + 1);
+	ref = malloc(max_pixels * 4 + 1);
+	if (dst == NULL || ref == NULL)
+	{
+		printf("error: failed malloc\n");
+		return 1;
+	}
+
+	printf("%s: %d textures, %lu pixels, kernel %s\n", filename, num_mips, (unsigned long)num_pixels, palette_kernel());
+
+	for (channels = 3; channels <= 4; channels++)
+	{
+		double start, t_plain, t_expand;
+
+		/* same bytes as the plain loop */
+		for (i = 0; i < num_mips; i++)
+		{
+			for (e = 0; e < mips[i]->header.num_entries; e++)
+			{
+				mip_entry_t *entry = &mips[i]->entries[e];
+				size_t n = (size_t)entry->width * entry->height;
+
+				expand_plain(&palette, entry->pixels, ref, n, channels);
+				palette_expand(&palette, entry->pixels, dst, n, channels);
+				if (memcmp(ref, dst, n * channels) != 0)
+					mismatches++;
+			}
+		}
+
+		start = now();
+		for (p = 0; p < passes; p++)
+		{
+			for (i = 0; i < num_mips; i++)
+			{
+				for (e = 0; e < mips[i]->header.num_entries; e++)
+				{
+					mip_entry_t *entry = &mips[i]->entries[e];
+					expand_plain(&palette, entry->pixels, dst, (size_t)entry->width * entry->height, channels);
+				}
+			}
+			sink = dst[0];
+		}
+		t_plain = now() - start;
+
+		start = now();
+		for (p = 0; p < passes; p++)
+		{
+			for (i = 0; i < num_mips; i++)
+			{
+				for (e = 0; e < mips[i]->header.num_entries; e++)
+				{
+					mip_entry_t *entry = &mips[i]->entries[e];
+					palette_expand(&palette, entry->pixels, dst, (size_t)entry->width * entry->height, channels);
+				}
+			}
+			sink = dst[0];
+		}
+		t_expand = now() - start;
+
+		/* report */
+		printf("%d channels: plain %6.2f ns/pixel, palette_expand %6.2f ns/pixel (%.0f Mpixel/s)\n",
+			channels,
+			t_plain * 1e9 / ((double)num_pixels * passes),
+			t_expand * 1e9 / ((double)num_pixels * passes),
+			(double)num_pixels * passes / t_expand / 1e6);
+	}
+
+	printf("%d mismatches against the plain loop\n", mismatches);
+
+	/* free memory */
+	for (i = 0; i < num_mips; i++)
+		mip_free(mips[i]);
+	free(mips);
+	free(dst);
+	free(ref);
+	wad_free(wad);
+
+	return mismatches != 0;
+}
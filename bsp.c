@@ -32,60 +32,158 @@ SOFTWARE.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdint.h>
 
 /* backend */
 #include "backend.h"
 
+/* file */
+#include "file.h"
+
+/* pool */
+#include "pool.h"
+
+/* number */
+#include "number.h"
+
+/* hash */
+#include "hash.h"
+
 /* bsp */
 #include "bsp.h"
 
+/*
+ *
+ * globals
+ *
+ */
+
+/* parser threads, 0 for one per cpu */
+static int bsp_threads = 0;
+
+/* called with node batches while parsing, if set */
+static bsp_batch_func_t bsp_batch_func = NULL;
+static void *bsp_batch_arg = NULL;
+
+/* polled between nodes and sections while parsing, if set */
+static bsp_abort_func_t bsp_abort_func = NULL;
+static void *bsp_abort_arg = NULL;
+
+/* polygons gathered before a batch goes out at the next node */
+#define BSP_BATCH_POLYGONS 4096
+
+/* size of the text writer's buffer */
+#define WRITER_LEN (1 << 20)
+
+/* smallest section worth splitting up */
+#define SECTION_MIN_TOKENS 65536
+
+/*
+ *
+ * types
+ *
+ */
+
+/* buffered text writer */
+typedef struct
+{
+	FILE *file;
+	char *buffer;
+	size_t len;
+	int error;
+} writer_t;
+
+/* text parser */
+typedef struct
+{
+	bsp_t *bsp;
+	lexer_t lexer;
+	pool_t *pool;
+
+	/* polygon vertex indices, moved into the arena at the end */
+	int *indices;
+	int num_indices;
+	int max_indices;
+
+	/* texture names, moved into the arena at the end */
+	bsp_texture_t *textures;
+	int num_textures;
+	int max_textures;
+
+	/* open addressed name hash, holding texture + 1 or 0 if empty */
+	int *table;
+	int len_table;
+
+	/* polygons read since the last batch */
+	int *batch;
+	int num_batch;
+	int max_batch;
+	int num_batches;
+
+	/* batch local vertex ids, valid where the stamp matches the batch */
+	int *vertex_stamp;
+	int *vertex_local;
+
+	/* set once the abort func asked to stop */
+	int aborted;
+} parser_t;
+
+/* chunk of a numeric section */
+typedef struct
+{
+	const char *start;
+	const char *end;
+	int first;
+	int count;
+	int max;
+	int is_float;
+	void *out;
+} section_chunk_t;
+
 /*
  *
  * functions
  *
  */
 
+/*
+ * whitespace table
+ */
+
+static const uint8_t whitespace[256] = {
+	['\t'] = 1, ['\n'] = 1, ['\v'] = 1, ['\f'] = 1, ['\r'] = 1, [' '] = 1
+};
+
 /*
  * token_read
  */
 
-int token_read(FILE *stream, token_t *token)
+int token_read(lexer_t *lexer, token_t *token)
 {
 	/* variables */
-	int i;
-	char c;
+	const char *ptr = lexer->ptr;
+	const char *end = lexer->end;
 
-	/* clear string */
-	for (i = 0; i < TOKEN_STR_LEN; i++) token->str[i] = '\0';
+	/* skip whitespace */
+	while (ptr < end && whitespace[(uint8_t)*ptr]) ptr++;
 
-	/* parse loop */
-	i = 0;
-	while (!feof(stream) && i < TOKEN_STR_LEN)
+	/* return failure if we've run out of buffer */
+	if (ptr >= end)
 	{
-		/* get char */
-		c = fgetc(stream);
-
-		/* return success if we've reached a space */
-		/* otherwise add to string */
-		if (isspace(c))
-		{
-			/* if we've just started, skip */
-			if (i == 0) continue;
-
-			/* return success */
-			token->len = i + 1;
-			return 1;
-		}
-		else
-		{
-			token->str[i++] = c;
-		}
+		lexer->ptr = end;
+		token->str = end;
+		token->len = 0;
+		return 0;
 	}
 
-	/* return failure */
-	return 0;
+	/* scan to the next space */
+	token->str = ptr;
+	while (ptr < end && !whitespace[(uint8_t)*ptr]) ptr++;
+	token->len = (int)(ptr - token->str);
+
+	/* return success */
+	lexer->ptr = ptr;
+	return 1;
 }
 
 /*
@@ -94,7 +192,9 @@ int token_read(FILE *stream, token_t *token)
 
 int token_string(token_t *token, const char *string)
 {
-	if (strcmp(token->str, string) != 0)
+	size_t len = strlen(string);
+
+	if ((size_t)token->len != len || memcmp(token->str, string, len) != 0)
 		return 0;
 
 	return 1;
@@ -104,12 +204,45 @@ int token_string(token_t *token, const char *string)
  * token_expect
  */
 
-int token_expect(FILE *stream, token_t *token, const char *string)
+int token_expect(lexer_t *lexer, token_t *token, const char *string)
 {
-	token_read(stream, token);
+	token_read(lexer, token);
 	return token_string(token, string);
 }
 
+/*
+ * token_copy
+ */
+
+void token_copy(token_t *token, char *string, int maxlen)
+{
+	int len = token->len < maxlen - 1 ? token->len : maxlen - 1;
+
+	if (maxlen <= 0)
+		return;
+
+	memcpy(string, token->str, len);
+	string[len] = '\0';
+}
+
+/*
+ * token_float
+ */
+
+float token_float(token_t *token)
+{
+	return number_double(token->str, token->len);
+}
+
+/*
+ * token_int
+ */
+
+int token_int(token_t *token)
+{
+	return number_int(token->str, token->len);
+}
+
 /*
  * print_vec3
  */
@@ -149,9 +282,10 @@ void print_node(FILE *stream, node_t *node, int n)
  * print_polygon
  */
 
-void print_polygon(FILE *stream, polygon_t *polygon, int n)
+void print_polygon(FILE *stream, bsp_t *bsp, int n)
 {
 	int i;
+	polygon_t *polygon = &bsp->polygons[n];
 
 	/* idx */
 	fprintf(stream, "polygon: %d\n", n);
@@ -160,11 +294,12 @@ void print_polygon(FILE *stream, polygon_t *polygon, int n)
 	fprintf(stream, "\tnum_verts: %d\n", polygon->num_verts);
 	fprintf(stream, "\tverts: ");
 	for (i = 0; i < polygon->num_verts; i++)
-		fprintf(stream, "%d ", polygon->verts[i]);
+		fprintf(stream, "%d ", bsp->indices[polygon->first_index + i]);
 	fprintf(stream, "\n");
 
 	/* tname */
-	fprintf(stream, "\ttname: %s\n", polygon->tname);
+	if (polygon->texture >= 0 && polygon->texture < bsp->num_textures)
+		fprintf(stream, "\ttname: %s\n", bsp->textures[polygon->texture].name);
 
 	/* tu */
 	fprintf(stream, "\ttu: ");
@@ -190,410 +325,1539 @@ void print_polygon(FILE *stream, polygon_t *polygon, int n)
  * read_vec3i
  */
 
-void read_vec3i(FILE *stream, vec3i_t *vec)
+void read_vec3i(lexer_t *lexer, vec3i_t *vec)
 {
 	/* variables */
 	token_t token;
 
-	token_read(stream, &token);
-	vec->x = atoi(token.str);
+	token_read(lexer, &token);
+	vec->x = token_int(&token);
 
-	token_read(stream, &token);
-	vec->y = atoi(token.str);
+	token_read(lexer, &token);
+	vec->y = token_int(&token);
 
-	token_read(stream, &token);
-	vec->z = atoi(token.str);
+	token_read(lexer, &token);
+	vec->z = token_int(&token);
 }
 
 /*
  * read_vec3
  */
 
-void read_vec3(FILE *stream, vec3_t *vec)
+void read_vec3(lexer_t *lexer, vec3_t *vec)
 {
 	/* variables */
 	token_t token;
 
-	token_read(stream, &token);
-	vec->x = atof(token.str);
+	token_read(lexer, &token);
+	vec->x = token_float(&token);
 
-	token_read(stream, &token);
-	vec->y = atof(token.str);
+	token_read(lexer, &token);
+	vec->y = token_float(&token);
 
-	token_read(stream, &token);
-	vec->z = atof(token.str);
+	token_read(lexer, &token);
+	vec->z = token_float(&token);
 }
 
 /*
  * read_float
  */
 
-void read_float(FILE *stream, float *f)
+void read_float(lexer_t *lexer, float *f)
 {
 	token_t token;
-	token_read(stream, &token);
-	*f = atof(token.str);
+	token_read(lexer, &token);
+	*f = token_float(&token);
 }
 
 /*
  * read_int
  */
 
-void read_int(FILE *stream, int *i)
+void read_int(lexer_t *lexer, int *i)
 {
 	token_t token;
-	token_read(stream, &token);
-	*i = atoi(token.str);
+	token_read(lexer, &token);
+	*i = token_int(&token);
 }
 
 /*
  * read_string
  */
 
-void read_string(FILE *stream, char *string, int maxlen)
+void read_string(lexer_t *lexer, char *string, int maxlen)
 {
 	token_t token;
-	token_read(stream, &token);
-	strncpy(string, token.str, maxlen);
+	token_read(lexer, &token);
+	token_copy(&token, string, maxlen);
+}
+
+/*
+ * parser_grow
+ */
+
+static int parser_grow(void **array, int *max, int num, size_t size)
+{
+	void *grown;
+	int newmax;
+
+	if (num < *max)
+		return 1;
+
+	newmax = *max ? *max * 2 : 1024;
+	grown = realloc(*array, (size_t)newmax * size);
+	if (grown == NULL)
+	{
+		printf("error: failed malloc\n");
+		return 0;
+	}
+
+	*array = grown;
+	*max = newmax;
+
+	return 1;
+}
+
+/*
+ * parser_rehash
+ */
+
+static int parser_rehash(parser_t *parser, int len_table)
+{
+	int *table;
+	int i, slot;
+
+	table = calloc(len_table, sizeof(int));
+	if (table == NULL)
+	{
+		printf("error: failed malloc\n");
+		return 0;
+	}
+
+	/* reinsert every name */
+	for (i = 0; i < parser->num_textures; i++)
+	{
+		slot = hash_fnv1a_string(parser->textures[i].name) & (len_table - 1);
+		while (table[slot])
+			slot = (slot + 1) & (len_table - 1);
+		table[slot] = i + 1;
+	}
+
+	free(parser->table);
+	parser->table = table;
+	parser->len_table = len_table;
+
+	return 1;
+}
+
+/*
+ * parser_texture
+ */
+
+static int parser_texture(parser_t *parser, token_t *token)
+{
+	bsp_texture_t texture;
+	int slot;
+
+	memset(&texture, 0, sizeof(texture));
+	token_copy(token, texture.name, sizeof(texture.name));
+
+	/* keep the table at most half full */
+	if (parser->num_textures * 2 >= parser->len_table)
+	{
+		if (!parser_rehash(parser, parser->len_table ? parser->len_table * 2 : 256))
+			return -1;
+	}
+
+	/* already seen */
+	slot = hash_fnv1a_string(texture.name) & (parser->len_table - 1);
+	while (parser->table[slot])
+	{
+		if (strcmp(parser->textures[parser->table[slot] - 1].name, texture.name) == 0)
+			return parser->table[slot] - 1;
+		slot = (slot + 1) & (parser->len_table - 1);
+	}
+
+	/* new name */
+	if (!parser_grow((void **)&parser->textures, &parser->max_textures, parser->num_textures, sizeof(bsp_texture_t)))
+		return -1;
+	parser->textures[parser->num_textures] = texture;
+	parser->table[slot] = parser->num_textures + 1;
+
+	return parser->num_textures++;
 }
 
 /*
  * read_polygon
  */
 
-void read_polygon(FILE *stream, polygon_t *polygon, int n)
+void read_polygon(parser_t *parser, polygon_t *polygon, int n)
 {
 	/* blah */
-	int i;
+	lexer_t *lexer = &parser->lexer;
 	token_t token;
 
 	/* verts */
-	i = 0;
-	if (token_expect(stream, &token, "verts"))
+	polygon->first_index = parser->num_indices;
+	if (token_expect(lexer, &token, "verts"))
 	{
 		/* tname is next */
-		while (!token_expect(stream, &token, "tname"))
+		while (!token_expect(lexer, &token, "tname") && token.len)
 		{
 			/* otherwise its a vert */
-			polygon->verts[i++] = atoi(token.str);
+			if (!parser_grow((void **)&parser->indices, &parser->max_indices, parser->num_indices, sizeof(int)))
+				break;
+			parser->indices[parser->num_indices++] = token_int(&token);
 		}
-
-		polygon->num_verts = i;
 	}
 	else
 	{
 		printf("error: no verts in polygon\n");
 	}
+	polygon->num_verts = parser->num_indices - polygon->first_index;
 
 	/* tname */
-	read_string(stream, polygon->tname, sizeof(polygon->tname));
+	token_read(lexer, &token);
+	polygon->texture = parser_texture(parser, &token);
 
 	/* tu */
-	if (token_expect(stream, &token, "tu"))
-		read_vec3(stream, &polygon->tu);
+	if (token_expect(lexer, &token, "tu"))
+		read_vec3(lexer, &polygon->tu);
 
 	/* tv */
-	if (token_expect(stream, &token, "tv"))
-		read_vec3(stream, &polygon->tv);
+	if (token_expect(lexer, &token, "tv"))
+		read_vec3(lexer, &polygon->tv);
 
 	/* to */
-	if (token_expect(stream, &token, "to"))
-		read_vec3(stream, &polygon->to);
+	if (token_expect(lexer, &token, "to"))
+		read_vec3(lexer, &polygon->to);
 
 	/* assign node */
 	polygon->node = n;
 }
 
 /*
- * read_node
+ * section_count
  */
 
-void read_node(bsp_t *bsp, FILE *stream, node_t *node, int n)
+static void section_count(void *arg)
 {
+	section_chunk_t *chunk = (section_chunk_t *)arg;
+	lexer_t lexer;
 	token_t token;
 
-	while (token_read(stream, &token))
-	{
-		/* A */
-		if (token_string(&token, "A"))
-			read_float(stream, &node->a);
-
-		/* B */
-		if (token_string(&token, "B"))
-			read_float(stream, &node->b);
-
-		/* C */
-		if (token_string(&token, "C"))
-			read_float(stream, &node->c);
+	lexer.ptr = chunk->start;
+	lexer.end = chunk->end;
 
-		/* D */
-		if (token_string(&token, "D"))
-			read_float(stream, &node->d);
+	chunk->count = 0;
+	while (token_read(&lexer, &token))
+		chunk->count++;
+}
 
-		/* inid */
-		if (token_string(&token, "inid"))
-			read_int(stream, &node->inid);
+/*
+ * section_parse
+ */
 
-		/* outid */
-		if (token_string(&token, "outid"))
-			read_int(stream, &node->outid);
+static void section_parse(void *arg)
+{
+	section_chunk_t *chunk = (section_chunk_t *)arg;
+	lexer_t lexer;
+	token_t token;
+	int i;
 
-		/* front */
-		if (token_string(&token, "front"))
-			read_int(stream, &node->front);
+	lexer.ptr = chunk->start;
+	lexer.end = chunk->end;
 
-		/* back */
-		if (token_string(&token, "back"))
-			read_int(stream, &node->back);
+	for (i = chunk->first; i < chunk->max && token_read(&lexer, &token); i++)
+	{
+		if (chunk->is_float)
+			((float *)chunk->out)[i] = token_float(&token);
+		else
+			((int *)chunk->out)[i] = token_int(&token);
+	}
+}
 
-		/* polygon */
-		if (token_string(&token, "polygon"))
-		{
-			int p;
-			read_int(stream, &p);
-			read_polygon(stream, &bsp->polygons[p], n);
-		}
+/*
+ * section_end
+ */
 
-		/* next node */
-		if (token_string(&token, "node"))
+static const char *section_end(const char *ptr, const char *end)
+{
+	/* numbers only have letters in their exponents, so the first */
+	/* token starting with a letter is the next keyword */
+	for (; ptr < end; ptr++)
+	{
+		if ((*ptr >= 'a' && *ptr <= 'z') || (*ptr >= 'A' && *ptr <= 'Z'))
 		{
-			int n;
-			read_int(stream, &n);
-			read_node(bsp, stream, &bsp->nodes[n], n);
+			if (whitespace[(uint8_t)ptr[-1]])
+				return ptr;
 		}
 	}
+
+	return end;
 }
 
 /*
- * bsp_read
+ * read_section
  */
 
-bsp_t *bsp_read(const char *filename)
+void read_section(lexer_t *lexer, pool_t *pool, void *out, int num, int is_float)
 {
 	/* variables */
-	FILE *file;
+	section_chunk_t chunks[64];
+	int num_chunks;
+	const char *start, *end;
+	int i, total;
 	token_t token;
-	bsp_t *bsp;
 
-	/* open file */
-	file = fopen(filename, "rb");
-	if (file == NULL)
-	{
-		printf("error: failed to open %s\n", filename);
-		return NULL;
-	}
-
-	/* alloc */
-	bsp = calloc(1, sizeof(bsp_t));
-	if (bsp == NULL)
-	{
-		printf("error: failed malloc\n");
-		return NULL;
-	}
-
-	/* token loop */
-	while (token_read(file, &token))
+	/* split big sections across the pool */
+	if (pool && num >= SECTION_MIN_TOKENS)
 	{
-		/*
-		 * read camera
-		 */
-
-		if (token_string(&token, "viewpoint"))
-			read_vec3(file, &bsp->camera.viewpoint);
-
-		if (token_string(&token, "viewnormal"))
-			read_vec3(file, &bsp->camera.viewnormal);
-
-		if (token_string(&token, "viewangle"))
-			read_int(file, &bsp->camera.viewangle);
-
-		if (token_string(&token, "texturelength"))
-			read_int(file, &bsp->camera.texturelength);
-
-		/* read xcomponents */
-		if (token_string(&token, "xcomponents"))
+		/* find the end of the section */
+		start = lexer->ptr;
+		end = section_end(start + 1, lexer->end);
+
+		/* cut it into chunks on whitespace */
+		num_chunks = bsp_threads > 0 ? bsp_threads * 2 : pool_num_cpus() * 2;
+		if (num_chunks > 64) num_chunks = 64;
+		for (i = 0; i < num_chunks; i++)
 		{
-			int x;
-			read_int(file, &bsp->num_xcomponents);
-			bsp->xcomponents = calloc(bsp->num_xcomponents, sizeof(component_t));
-			for (x = 0; x < bsp->num_xcomponents; x++) read_float(file, &bsp->xcomponents[x]);
-			#if DEBUG
-			printf("%d xcomponents read\n", bsp->num_xcomponents);
-			#endif
+			chunks[i].start = i ? chunks[i - 1].end : start;
+			chunks[i].end = start + (end - start) * (i + 1) / num_chunks;
+			while (chunks[i].end < end && !whitespace[(uint8_t)*chunks[i].end])
+				chunks[i].end++;
+			chunks[i].max = num;
+			chunks[i].is_float = is_float;
+			chunks[i].out = out;
+			pool_submit(pool, section_count, &chunks[i]);
 		}
+		pool_wait(pool);
 
-		/* read ycomponents */
-		if (token_string(&token, "ycomponents"))
+		/* work out where each chunk's tokens go */
+		total = 0;
+		for (i = 0; i < num_chunks; i++)
 		{
-			int y;
-			read_int(file, &bsp->num_ycomponents);
-			bsp->ycomponents = calloc(bsp->num_ycomponents, sizeof(component_t));
-			for (y = 0; y < bsp->num_ycomponents; y++) read_float(file, &bsp->ycomponents[y]);
-			#if DEBUG
-			printf("%d ycomponents read\n", bsp->num_ycomponents);
-			#endif
+			chunks[i].first = total;
+			total += chunks[i].count;
 		}
 
-		/* read zcomponents */
-		if (token_string(&token, "zcomponents"))
+		/* only trust the split if it has exactly the right count */
+		if (total == num)
 		{
-			int z;
-			read_int(file, &bsp->num_zcomponents);
-			bsp->zcomponents = calloc(bsp->num_zcomponents, sizeof(component_t));
-			for (z = 0; z < bsp->num_zcomponents; z++) read_float(file, &bsp->zcomponents[z]);
-			#if DEBUG
-			printf("%d zcomponents read\n", bsp->num_zcomponents);
-			#endif
+			for (i = 0; i < num_chunks; i++)
+				pool_submit(pool, section_parse, &chunks[i]);
+			pool_wait(pool);
+
+			lexer->ptr = end;
+			return;
 		}
+	}
 
-		/* read vertices */
-		if (token_string(&token, "numverts"))
-		{
-			int v;
+	/* read it one token at a time */
+	for (i = 0; i < num; i++)
+	{
+		token_read(lexer, &token);
+		if (is_float)
+			((float *)out)[i] = token_float(&token);
+		else
+			((int *)out)[i] = token_int(&token);
+	}
+}
 
-			read_int(file, &bsp->num_vertices);
+/*
+ * lump sizes
+ */
 
-			bsp->vertices = calloc(bsp->num_vertices, sizeof(vec3i_t));
+static const uint32_t lump_sizes[BSP_NUM_LUMPS] = {
+	[BSP_LUMP_XCOMPONENTS] = sizeof(component_t),
+	[BSP_LUMP_YCOMPONENTS] = sizeof(component_t),
+	[BSP_LUMP_ZCOMPONENTS] = sizeof(component_t),
+	[BSP_LUMP_VERTICES] = sizeof(vec3i_t),
+	[BSP_LUMP_POLYGONS] = sizeof(polygon_t),
+	[BSP_LUMP_NODES] = sizeof(node_t),
+	[BSP_LUMP_INDICES] = sizeof(int),
+	[BSP_LUMP_TEXTURES] = sizeof(bsp_texture_t)
+};
 
-			for (v = 0; v < bsp->num_vertices; v++)
-			{
-				read_vec3i(file, &bsp->vertices[v]);
-			}
+/*
+ * bsp_fixup
+ */
 
-			#if DEBUG
-			printf("%d vertices read\n", bsp->num_vertices);
-			#endif
-		}
+static void bsp_fixup(bsp_t *bsp)
+{
+	/* variables */
+	uint8_t *base = (uint8_t *)bsp->header;
+	bsp_lump_t *lumps = bsp->header->lumps;
+
+	#define FIXUP(lump, array, count) \
+		bsp->array = lumps[lump].num ? (void *)(base + lumps[lump].ofs) : NULL; \
+		bsp->count = lumps[lump].num;
+
+	FIXUP(BSP_LUMP_XCOMPONENTS, xcomponents, num_xcomponents);
+	FIXUP(BSP_LUMP_YCOMPONENTS, ycomponents, num_ycomponents);
+	FIXUP(BSP_LUMP_ZCOMPONENTS, zcomponents, num_zcomponents);
+	FIXUP(BSP_LUMP_VERTICES, vertices, num_vertices);
+	FIXUP(BSP_LUMP_POLYGONS, polygons, num_polygons);
+	FIXUP(BSP_LUMP_NODES, nodes, num_nodes);
+	FIXUP(BSP_LUMP_INDICES, indices, num_indices);
+	FIXUP(BSP_LUMP_TEXTURES, textures, num_textures);
+
+	#undef FIXUP
+}
 
-		/* allocate nodes */
-		if (token_string(&token, "numnodes"))
-		{
-			read_int(file, &bsp->num_nodes);
-			bsp->nodes = calloc(bsp->num_nodes, sizeof(node_t));
-			#if DEBUG
-			printf("%d nodes read\n", bsp->num_nodes);
-			#endif
-		}
+/*
+ * bsp_alloc
+ */
 
-		/* allocate polygons */
-		if (token_string(&token, "numpolys"))
-		{
-			read_int(file, &bsp->num_polygons);
-			bsp->polygons = calloc(bsp->num_polygons, sizeof(polygon_t));
-			#if DEBUG
-			printf("%d poylgons read\n", bsp->num_polygons);
-			#endif
-		}
+static int bsp_alloc(bsp_t *bsp, int lump, int num)
+{
+	/* variables */
+	size_t ofs, len, max;
+	uint8_t *arena;
 
-		/* read node */
-		if (token_string(&token, "node"))
+	/* place lump at the end of the arena */
+	if (num < 0) num = 0;
+	ofs = (bsp->len_arena + BSP_CACHE_ALIGN - 1) & ~(size_t)(BSP_CACHE_ALIGN - 1);
+	if ((uint32_t)num > (UINT32_MAX - ofs) / lump_sizes[lump])
+	{
+		printf("error: bsp is too large\n");
+		return 0;
+	}
+	len = (size_t)num * lump_sizes[lump];
+
+	/* grow */
+	if (ofs + len > bsp->max_arena)
+	{
+		max = bsp->max_arena;
+		while (max < ofs + len) max *= 2;
+		arena = realloc(bsp->arena, max);
+		if (arena == NULL)
 		{
-			int n;
-			read_int(file, &n);
-			read_node(bsp, file, &bsp->nodes[n], n);
+			printf("error: failed malloc\n");
+			return 0;
 		}
+		bsp->arena = arena;
+		bsp->max_arena = max;
+		bsp->header = (bsp_header_t *)arena;
 	}
 
-	/* close file */
-	fclose(file);
+	/* clear */
+	memset(bsp->arena + bsp->len_arena, 0, ofs + len - bsp->len_arena);
+	bsp->len_arena = ofs + len;
 
-	/* return ptr */
-	return bsp;
+	/* record lump */
+	bsp->header->lumps[lump].ofs = (uint32_t)ofs;
+	bsp->header->lumps[lump].num = (uint32_t)num;
+	bsp_fixup(bsp);
+
+	return 1;
 }
 
 /*
- * bsp_free
+ * parser_abort
  */
 
-void bsp_free(bsp_t *bsp)
+static int parser_abort(parser_t *parser)
 {
-	if (bsp)
+	if (!parser->aborted && bsp_abort_func && bsp_abort_func(bsp_abort_arg))
+		parser->aborted = 1;
+
+	return parser->aborted;
+}
+
+/*
+ * parser_flush_batch
+ */
+
+static void parser_flush_batch(parser_t *parser)
+{
+	/* variables */
+	bsp_t *bsp = parser->bsp;
+	bsp_t *batch;
+	polygon_t *polygon;
+	int *texture_local;
+	int num_verts = 0, num_indices = 0, num_textures = 0;
+	int i, k, v, stamp;
+	uint8_t *block;
+
+	if (parser->num_batch == 0)
+		return;
+
+	/* vertex ids are remapped per batch, without clearing between them */
+	if (parser->vertex_stamp == NULL)
+	{
+		parser->vertex_stamp = calloc(bsp->num_vertices + 1, sizeof(int));
+		parser->vertex_local = malloc((bsp->num_vertices + 1) * sizeof(int));
+	}
+
+	batch = calloc(1, sizeof(bsp_t));
+	texture_local = calloc(parser->num_textures + 1, sizeof(int));
+	if (parser->vertex_stamp == NULL || parser->vertex_local == NULL || batch == NULL || texture_local == NULL)
+	{
+		printf("error: failed malloc\n");
+		free(batch);
+		free(texture_local);
+		parser->num_batch = 0;
+		return;
+	}
+
+	/* count indices and the textures used, texture_local holds batch texture + 1 */
+	for (i = 0; i < parser->num_batch; i++)
+	{
+		polygon = &bsp->polygons[parser->batch[i]];
+		num_indices += polygon->num_verts;
+
+		if ((unsigned)polygon->texture < (unsigned)parser->num_textures && !texture_local[polygon->texture])
+			texture_local[polygon->texture] = ++num_textures;
+	}
+
+	/* one block the batch owns, freed by bsp_free, with room for a */
+	/* position per index since shared vertices aren't known yet */
+	block = malloc(num_indices * (sizeof(vec3_t) + sizeof(int)) +
+		parser->num_batch * sizeof(polygon_t) + num_textures * sizeof(bsp_texture_t) + 1);
+	if (block == NULL)
+	{
+		printf("error: failed malloc\n");
+		free(batch);
+		free(texture_local);
+		parser->num_batch = 0;
+		return;
+	}
+
+	batch->camera = bsp->camera;
+	batch->resolved = block;
+	batch->positions = (vec3_t *)block;
+	batch->polygons = (polygon_t *)(batch->positions + num_indices);
+	batch->num_polygons = parser->num_batch;
+	batch->indices = (int *)(batch->polygons + parser->num_batch);
+	batch->num_indices = num_indices;
+	batch->textures = (bsp_texture_t *)(batch->indices + num_indices);
+	batch->num_textures = num_textures;
+
+	/* polygons and their indices, resolving each vertex the first time */
+	/* it's seen, since the components were all read before the nodes */
+	stamp = ++parser->num_batches;
+	num_indices = 0;
+	for (i = 0; i < parser->num_batch; i++)
+	{
+		polygon = &batch->polygons[i];
+		*polygon = bsp->polygons[parser->batch[i]];
+
+		for (k = 0; k < polygon->num_verts; k++)
+		{
+			v = parser->indices[polygon->first_index + k];
+
+			/* out of range vertices stay out of range */
+			if ((unsigned)v >= (unsigned)bsp->num_vertices)
+			{
+				batch->indices[num_indices + k] = -1;
+				continue;
+			}
+
+			if (parser->vertex_stamp[v] != stamp)
+			{
+				vec3i_t *vertex = &bsp->vertices[v];
+				vec3_t *pos = &batch->positions[num_verts];
+
+				pos->x = (unsigned)vertex->x < (unsigned)bsp->num_xcomponents ? bsp->xcomponents[vertex->x] : 0.0f;
+				pos->y = (unsigned)vertex->y < (unsigned)bsp->num_ycomponents ? bsp->ycomponents[vertex->y] : 0.0f;
+				pos->z = (unsigned)vertex->z < (unsigned)bsp->num_zcomponents ? bsp->zcomponents[vertex->z] : 0.0f;
+
+				parser->vertex_stamp[v] = stamp;
+				parser->vertex_local[v] = num_verts++;
+			}
+
+			batch->indices[num_indices + k] = parser->vertex_local[v];
+		}
+
+		polygon->first_index = num_indices;
+		num_indices += polygon->num_verts;
+		polygon->texture = (unsigned)polygon->texture < (unsigned)parser->num_textures ? texture_local[polygon->texture] - 1 : -1;
+	}
+	batch->num_vertices = num_verts;
+
+	for (i = 0; i < parser->num_textures; i++)
+	{
+		if (texture_local[i])
+			batch->textures[texture_local[i] - 1] = parser->textures[i];
+	}
+
+	free(texture_local);
+	parser->num_batch = 0;
+
+	/* hand it over */
+	bsp_batch_func(batch, bsp_batch_arg);
+}
+
+/*
+ * read_node
+ */
+
+void read_node(parser_t *parser, int n)
+{
+	/* variables */
+	bsp_t *bsp = parser->bsp;
+	lexer_t *lexer = &parser->lexer;
+	token_t token;
+	node_t scratch;
+	node_t *node;
+
+	/* there's nothing closing a node in the file, so each node token */
+	/* just switches which node the following fields belong to */
+	node = n >= 0 && n < bsp->num_nodes ? &bsp->nodes[n] : &scratch;
+
+	while (token_read(lexer, &token))
+	{
+		/* A */
+		if (token_string(&token, "A"))
+			read_float(lexer, &node->a);
+
+		/* B */
+		if (token_string(&token, "B"))
+			read_float(lexer, &node->b);
+
+		/* C */
+		if (token_string(&token, "C"))
+			read_float(lexer, &node->c);
+
+		/* D */
+		if (token_string(&token, "D"))
+			read_float(lexer, &node->d);
+
+		/* inid */
+		if (token_string(&token, "inid"))
+			read_int(lexer, &node->inid);
+
+		/* outid */
+		if (token_string(&token, "outid"))
+			read_int(lexer, &node->outid);
+
+		/* front */
+		if (token_string(&token, "front"))
+			read_int(lexer, &node->front);
+
+		/* back */
+		if (token_string(&token, "back"))
+			read_int(lexer, &node->back);
+
+		/* polygon */
+		if (token_string(&token, "polygon"))
+		{
+			int p;
+			polygon_t dummy;
+			read_int(lexer, &p);
+			if (p >= 0 && p < bsp->num_polygons)
+			{
+				read_polygon(parser, &bsp->polygons[p], n);
+
+				/* remember it for the next batch */
+				if (bsp_batch_func && parser_grow((void **)&parser->batch, &parser->max_batch, parser->num_batch, sizeof(int)))
+					parser->batch[parser->num_batch++] = p;
+			}
+			else
+			{
+				printf("error: polygon %d out of range\n", p);
+				read_polygon(parser, &dummy, n);
+			}
+		}
+
+		/* next node */
+		if (token_string(&token, "node"))
+		{
+			/* nobody wants the rest */
+			if (parser_abort(parser))
+				return;
+
+			/* batches only end between nodes */
+			if (parser->num_batch >= BSP_BATCH_POLYGONS)
+				parser_flush_batch(parser);
+
+			read_int(lexer, &n);
+			if (n >= 0 && n < bsp->num_nodes)
+			{
+				node = &bsp->nodes[n];
+			}
+			else
+			{
+				/* -1 holds the polygons without a node */
+				if (n != -1)
+					printf("error: node %d out of range\n", n);
+				node = &scratch;
+			}
+		}
+	}
+}
+
+/*
+ * bsp_from_text
+ */
+
+static bsp_t *bsp_from_text(const char *buffer, size_t buffer_len)
+{
+	/* variables */
+	parser_t parser;
+	lexer_t *lexer = &parser.lexer;
+	token_t token;
+	bsp_t *bsp;
+	uint8_t *arena;
+	int num;
+
+	/* alloc */
+	bsp = calloc(1, sizeof(bsp_t));
+	if (bsp == NULL)
 	{
-		if (bsp->xcomponents) free(bsp->xcomponents);
-		if (bsp->ycomponents) free(bsp->ycomponents);
-		if (bsp->zcomponents) free(bsp->zcomponents);
-		if (bsp->vertices) free(bsp->vertices);
-		if (bsp->polygons) free(bsp->polygons);
-		if (bsp->nodes) free(bsp->nodes);
+		printf("error: failed malloc\n");
+		return NULL;
+	}
 
+	/* alloc arena, starting with a binary bsp header */
+	bsp->max_arena = sizeof(bsp_header_t) + buffer_len / 2 + 4096;
+	bsp->arena = calloc(1, bsp->max_arena);
+	if (bsp->arena == NULL)
+	{
+		printf("error: failed malloc\n");
 		free(bsp);
+		return NULL;
 	}
+	bsp->len_arena = sizeof(bsp_header_t);
+	bsp->header = (bsp_header_t *)bsp->arena;
+	memcpy(bsp->header->magic, BSP_CACHE_MAGIC, 4);
+	bsp->header->version = BSP_CACHE_VERSION;
+
+	/* init parser */
+	memset(&parser, 0, sizeof(parser));
+	parser.bsp = bsp;
+	lexer->ptr = buffer;
+	lexer->end = buffer + buffer_len;
+
+	/* start parser threads for big files */
+	if (bsp_threads != 1 && buffer_len >= (1 << 20))
+		parser.pool = pool_create(bsp_threads);
+
+	/* token loop */
+	while (!parser_abort(&parser) && token_read(lexer, &token))
+	{
+		/*
+		 * read camera
+		 */
+
+		if (token_string(&token, "viewpoint"))
+			read_vec3(lexer, &bsp->camera.viewpoint);
+
+		if (token_string(&token, "viewnormal"))
+			read_vec3(lexer, &bsp->camera.viewnormal);
+
+		if (token_string(&token, "viewangle"))
+			read_int(lexer, &bsp->camera.viewangle);
+
+		if (token_string(&token, "texturelength"))
+			read_int(lexer, &bsp->camera.texturelength);
+
+		/* read xcomponents */
+		if (token_string(&token, "xcomponents"))
+		{
+			read_int(lexer, &num);
+			if (!bsp_alloc(bsp, BSP_LUMP_XCOMPONENTS, num)) break;
+			read_section(lexer, parser.pool, bsp->xcomponents, bsp->num_xcomponents, 1);
+			#if DEBUG
+			printf("%d xcomponents read\n", bsp->num_xcomponents);
+			#endif
+		}
+
+		/* read ycomponents */
+		if (token_string(&token, "ycomponents"))
+		{
+			read_int(lexer, &num);
+			if (!bsp_alloc(bsp, BSP_LUMP_YCOMPONENTS, num)) break;
+			read_section(lexer, parser.pool, bsp->ycomponents, bsp->num_ycomponents, 1);
+			#if DEBUG
+			printf("%d ycomponents read\n", bsp->num_ycomponents);
+			#endif
+		}
+
+		/* read zcomponents */
+		if (token_string(&token, "zcomponents"))
+		{
+			read_int(lexer, &num);
+			if (!bsp_alloc(bsp, BSP_LUMP_ZCOMPONENTS, num)) break;
+			read_section(lexer, parser.pool, bsp->zcomponents, bsp->num_zcomponents, 1);
+			#if DEBUG
+			printf("%d zcomponents read\n", bsp->num_zcomponents);
+			#endif
+		}
+
+		/* read vertices */
+		if (token_string(&token, "numverts"))
+		{
+			read_int(lexer, &num);
+			if (!bsp_alloc(bsp, BSP_LUMP_VERTICES, num)) break;
+
+			/* vertices are three ints each */
+			read_section(lexer, parser.pool, bsp->vertices, bsp->num_vertices * 3, 0);
+
+			#if DEBUG
+			printf("%d vertices read\n", bsp->num_vertices);
+			#endif
+		}
+
+		/* allocate nodes */
+		if (token_string(&token, "numnodes"))
+		{
+			read_int(lexer, &num);
+			if (!bsp_alloc(bsp, BSP_LUMP_NODES, num)) break;
+			#if DEBUG
+			printf("%d nodes read\n", bsp->num_nodes);
+			#endif
+		}
+
+		/* allocate polygons */
+		if (token_string(&token, "numpolys"))
+		{
+			read_int(lexer, &num);
+			if (!bsp_alloc(bsp, BSP_LUMP_POLYGONS, num)) break;
+			for (num = 0; num < bsp->num_polygons; num++)
+				bsp->polygons[num].texture = -1;
+			#if DEBUG
+			printf("%d poylgons read\n", bsp->num_polygons);
+			#endif
+		}
+
+		/* read nodes */
+		if (token_string(&token, "node"))
+		{
+			int n;
+			read_int(lexer, &n);
+			read_node(&parser, n);
+		}
+	}
+
+	/* stop parser threads */
+	pool_destroy(parser.pool);
+
+	/* the rest of the nodes */
+	if (!parser.aborted)
+		parser_flush_batch(&parser);
+	free(parser.batch);
+	free(parser.vertex_stamp);
+	free(parser.vertex_local);
+
+	/* given up part way, quietly */
+	if (parser.aborted)
+	{
+		free(parser.indices);
+		free(parser.textures);
+		free(parser.table);
+		bsp_free(bsp);
+		return NULL;
+	}
+
+	/* move the index pool and texture names into the arena */
+	if (bsp_alloc(bsp, BSP_LUMP_INDICES, parser.num_indices))
+		memcpy(bsp->indices, parser.indices, parser.num_indices * sizeof(int));
+	if (bsp_alloc(bsp, BSP_LUMP_TEXTURES, parser.num_textures))
+		memcpy(bsp->textures, parser.textures, parser.num_textures * sizeof(bsp_texture_t));
+	free(parser.indices);
+	free(parser.textures);
+	free(parser.table);
+
+	/* give back the slack */
+	arena = realloc(bsp->arena, bsp->len_arena);
+	if (arena)
+	{
+		bsp->arena = arena;
+		bsp->max_arena = bsp->len_arena;
+		bsp->header = (bsp_header_t *)arena;
+		bsp_fixup(bsp);
+	}
+
+	/* finish header */
+	bsp->header->len = (uint32_t)bsp->len_arena;
+	bsp->header->camera = bsp->camera;
+
+	/* return ptr */
+	return bsp;
 }
 
 /*
- * bsp_save
+ * bsp_write_cache
  */
 
-void bsp_save(bsp_t *bsp, const char *filename)
+static int bsp_write_cache(bsp_t *bsp, const char *filename, size_t len_source, int64_t mtime_source)
 {
 	/* variables */
 	FILE *file;
-	int i;
+	bsp_header_t header;
+
+	/* the arrays already sit in a binary bsp image */
+	header = *bsp->header;
+	header.camera = bsp->camera;
+	header.len_source = len_source;
+	header.mtime_source = mtime_source;
 
 	/* open file */
 	file = fopen(filename, "wb");
 	if (file == NULL)
+		return 0;
+
+	/* write header and lumps */
+	fwrite(&header, sizeof(bsp_header_t), 1, file);
+	fwrite((uint8_t *)bsp->header + sizeof(bsp_header_t), header.len - sizeof(bsp_header_t), 1, file);
+
+	/* close file */
+	if (ferror(file))
+	{
+		fclose(file);
+		remove(filename);
+		return 0;
+	}
+	fclose(file);
+
+	return 1;
+}
+
+/*
+ * bsp_from_cache
+ */
+
+static bsp_t *bsp_from_cache(const void *buffer, size_t buffer_len)
+{
+	/* variables */
+	bsp_header_t header;
+	bsp_t *bsp;
+	int i;
+
+	/* check header */
+	memcpy(&header, buffer, sizeof(bsp_header_t));
+	if (header.version != BSP_CACHE_VERSION || header.len != buffer_len)
+	{
+		printf("error: unsupported binary bsp\n");
+		return NULL;
+	}
+
+	/* check lumps */
+	for (i = 0; i < BSP_NUM_LUMPS; i++)
+	{
+		if (header.lumps[i].ofs % BSP_CACHE_ALIGN ||
+			header.lumps[i].num > INT32_MAX / lump_sizes[i] ||
+			header.lumps[i].ofs > header.len ||
+			(size_t)header.lumps[i].num * lump_sizes[i] > header.len - header.lumps[i].ofs)
+		{
+			printf("error: corrupt binary bsp\n");
+			return NULL;
+		}
+	}
+
+	/* alloc */
+	bsp = calloc(1, sizeof(bsp_t));
+	if (bsp == NULL)
+	{
+		printf("error: failed malloc\n");
+		return NULL;
+	}
+
+	/* point arrays into the buffer */
+	bsp->header = (bsp_header_t *)buffer;
+	bsp->camera = header.camera;
+	bsp_fixup(bsp);
+
+	/* polygons must stay inside the index pool and the textures, */
+	/* only the ones the tree never defined go without a texture */
+	for (i = 0; i < bsp->num_polygons; i++)
+	{
+		polygon_t *polygon = &bsp->polygons[i];
+		if (polygon->first_index < 0 || polygon->num_verts < 0 ||
+			polygon->first_index > bsp->num_indices - polygon->num_verts ||
+			polygon->texture >= bsp->num_textures ||
+			(polygon->texture < 0 && (polygon->texture != -1 || polygon->num_verts != 0)))
+		{
+			printf("error: corrupt binary bsp\n");
+			free(bsp);
+			return NULL;
+		}
+	}
+
+	/* names get used as strings */
+	for (i = 0; i < bsp->num_textures; i++)
+	{
+		if (memchr(bsp->textures[i].name, '\0', sizeof(bsp->textures[i].name)) == NULL)
+		{
+			printf("error: corrupt binary bsp\n");
+			free(bsp);
+			return NULL;
+		}
+	}
+
+	return bsp;
+}
+
+/*
+ * bsp_from_buffer
+ */
+
+bsp_t *bsp_from_buffer(const void *buffer, size_t buffer_len)
+{
+	/* binary bsps are used in place, so the buffer must outlive the bsp */
+	if (buffer_len >= sizeof(bsp_header_t) && memcmp(buffer, BSP_CACHE_MAGIC, 4) == 0)
+	{
+		if ((uintptr_t)buffer % BSP_CACHE_ALIGN)
+		{
+			printf("error: binary bsp buffer is misaligned\n");
+			return NULL;
+		}
+
+		return bsp_from_cache(buffer, buffer_len);
+	}
+
+	return bsp_from_text((const char *)buffer, buffer_len);
+}
+
+/*
+ * bsp_cache_fresh
+ */
+
+static int bsp_cache_fresh(file_t *file, size_t len_source, int64_t mtime_source)
+{
+	bsp_header_t header;
+
+	if (file->len < sizeof(bsp_header_t))
+		return 0;
+
+	memcpy(&header, file->data, sizeof(bsp_header_t));
+	if (memcmp(header.magic, BSP_CACHE_MAGIC, 4) != 0 ||
+		header.version != BSP_CACHE_VERSION ||
+		header.len_source != len_source ||
+		header.mtime_source != mtime_source)
+		return 0;
+
+	return 1;
+}
+
+/*
+ * bsp_read
+ */
+
+bsp_t *bsp_read(const char *filename)
+{
+	/* variables */
+	bsp_t *bsp;
+	file_t *file;
+	char *cachename;
+	char *tempname;
+	int64_t mtime_source = 0;
+	size_t len_source = 0;
+
+	/* cache lives next to the source */
+	cachename = malloc(strlen(filename) + 10);
+	tempname = malloc(strlen(filename) + 10);
+	if (cachename == NULL || tempname == NULL)
+	{
+		printf("error: failed malloc\n");
+		free(cachename);
+		free(tempname);
+		return NULL;
+	}
+	sprintf(cachename, "%s.bspc", filename);
+	sprintf(tempname, "%s.bspc~", filename);
+
+	/* use the cache if it was written from this exact source */
+	bsp = NULL;
+	if (file_stat(filename, &mtime_source, &len_source))
+	{
+		file = file_map(cachename);
+		if (file && bsp_cache_fresh(file, len_source, mtime_source))
+			bsp = bsp_from_buffer(file->data, file->len);
+
+		/* the bsp keeps the mapping */
+		if (bsp)
+			bsp->file = file;
+		else
+			file_unmap(file);
+	}
+
+	/* otherwise parse the source and write a new cache */
+	if (bsp == NULL)
+	{
+		file = file_map(filename);
+		if (file == NULL)
+		{
+			printf("error: failed to open %s\n", filename);
+			free(cachename);
+			free(tempname);
+			return NULL;
+		}
+
+		bsp = bsp_from_buffer(file->data, file->len);
+		if (bsp && bsp->arena && bsp_write_cache(bsp, tempname, file->len, mtime_source))
+		{
+			remove(cachename);
+			if (rename(tempname, cachename) != 0)
+				remove(tempname);
+		}
+
+		/* binary sources keep their mapping too */
+		if (bsp && !bsp->arena)
+			bsp->file = file;
+		else
+			file_unmap(file);
+	}
+
+	free(cachename);
+	free(tempname);
+
+	return bsp;
+}
+
+/*
+ * bsp_set_threads
+ */
+
+void bsp_set_threads(int num_threads)
+{
+	bsp_threads = num_threads > 0 ? num_threads : 0;
+}
+
+/*
+ * bsp_set_batch_func
+ */
+
+void bsp_set_batch_func(bsp_batch_func_t func, void *arg)
+{
+	bsp_batch_func = func;
+	bsp_batch_arg = arg;
+}
+
+/*
+ * bsp_set_abort_func
+ */
+
+void bsp_set_abort_func(bsp_abort_func_t func, void *arg)
+{
+	bsp_abort_func = func;
+	bsp_abort_arg = arg;
+}
+
+/*
+ * resolve_axis
+ */
+
+static int resolve_axis(float *out, int stride, const component_t *components, int num_components, const int *index, int num_vertices)
+{
+	int i, c, bad = 0;
+
+	/* check first so the copy below has no branches */
+	for (i = 0; i < num_vertices; i++)
+		bad += (unsigned)index[i * 3] >= (unsigned)num_components;
+
+	if (bad)
+	{
+		for (i = 0; i < num_vertices; i++)
+		{
+			c = index[i * 3];
+			out[i * stride] = (unsigned)c < (unsigned)num_components ? components[c] : 0.0f;
+		}
+	}
+	else
+	{
+		for (i = 0; i < num_vertices; i++)
+			out[i * stride] = components[index[i * 3]];
+	}
+
+	return bad;
+}
+
+/*
+ * bsp_resolve_positions
+ */
+
+int bsp_resolve_positions(bsp_t *bsp, int flags)
+{
+	/* variables */
+	const int *index = (const int *)bsp->vertices;
+	size_t len = 0;
+	float *block;
+	int n = bsp->num_vertices;
+	int bad = 0;
+
+	/* drop any previous build */
+	free(bsp->resolved);
+	bsp->resolved = NULL;
+	bsp->positions_x = bsp->positions_y = bsp->positions_z = NULL;
+	bsp->positions = NULL;
+
+	/* one block for every requested form */
+	if (flags & BSP_POSITIONS_SOA) len += (size_t)n * 3;
+	if (flags & BSP_POSITIONS_INTERLEAVED) len += (size_t)n * 3;
+	if (len == 0)
+		return 1;
+
+	block = malloc(len * sizeof(float));
+	if (block == NULL)
+	{
+		printf("error: failed malloc\n");
+		return 0;
+	}
+	bsp->resolved = block;
+
+	/* structure of arrays */
+	if (flags & BSP_POSITIONS_SOA)
+	{
+		bsp->positions_x = block;
+		bsp->positions_y = block + n;
+		bsp->positions_z = block + n * 2;
+		bad += resolve_axis(bsp->positions_x, 1, bsp->xcomponents, bsp->num_xcomponents, index, n);
+		bad += resolve_axis(bsp->positions_y, 1, bsp->ycomponents, bsp->num_ycomponents, index + 1, n);
+		bad += resolve_axis(bsp->positions_z, 1, bsp->zcomponents, bsp->num_zcomponents, index + 2, n);
+		block += (size_t)n * 3;
+	}
+
+	/* interleaved */
+	if (flags & BSP_POSITIONS_INTERLEAVED)
+	{
+		bsp->positions = (vec3_t *)block;
+		bad += resolve_axis(&bsp->positions->x, 3, bsp->xcomponents, bsp->num_xcomponents, index, n);
+		bad += resolve_axis(&bsp->positions->y, 3, bsp->ycomponents, bsp->num_ycomponents, index + 1, n);
+		bad += resolve_axis(&bsp->positions->z, 3, bsp->zcomponents, bsp->num_zcomponents, index + 2, n);
+	}
+
+	if (bad)
+		printf("error: %d vertex components out of range\n", bad);
+
+	return 1;
+}
+
+/*
+ * bsp_free
+ */
+
+void bsp_free(bsp_t *bsp)
+{
+	if (bsp)
+	{
+		if (bsp->resolved) free(bsp->resolved);
+		if (bsp->arena) free(bsp->arena);
+		if (bsp->file) file_unmap(bsp->file);
+		free(bsp);
+	}
+}
+
+/*
+ * writer_flush
+ */
+
+static void writer_flush(writer_t *writer)
+{
+	if (writer->len)
+	{
+		if (fwrite(writer->buffer, writer->len, 1, writer->file) != 1)
+			writer->error = 1;
+		writer->len = 0;
+	}
+}
+
+/*
+ * writer_reserve
+ */
+
+static char *writer_reserve(writer_t *writer, size_t len)
+{
+	if (writer->len + len > WRITER_LEN)
+		writer_flush(writer);
+
+	return writer->buffer + writer->len;
+}
+
+/*
+ * writer_string
+ */
+
+static void writer_string(writer_t *writer, const char *string)
+{
+	size_t len = strlen(string);
+
+	/* strings longer than the buffer go straight out */
+	if (len > WRITER_LEN)
+	{
+		writer_flush(writer);
+		if (fwrite(string, len, 1, writer->file) != 1)
+			writer->error = 1;
+		return;
+	}
+
+	memcpy(writer_reserve(writer, len), string, len);
+	writer->len += len;
+}
+
+/*
+ * writer_int
+ */
+
+static void writer_int(writer_t *writer, int value, char end)
+{
+	char *str = writer_reserve(writer, NUMBER_FORMAT_LEN);
+	int len = number_format_int(str, value);
+	if (end) str[len++] = end;
+	writer->len += len;
+}
+
+/*
+ * writer_float
+ */
+
+static void writer_float(writer_t *writer, float value, char end)
+{
+	char *str = writer_reserve(writer, NUMBER_FORMAT_LEN);
+	int len = number_format_float(str, value);
+	if (end) str[len++] = end;
+	writer->len += len;
+}
+
+/*
+ * writer_vec3
+ */
+
+static void writer_vec3(writer_t *writer, vec3_t *vec)
+{
+	writer_float(writer, vec->x, ' ');
+	writer_float(writer, vec->y, ' ');
+	writer_float(writer, vec->z, '\n');
+}
+
+/*
+ * writer_vec3i
+ */
+
+static void writer_vec3i(writer_t *writer, vec3i_t *vec)
+{
+	writer_int(writer, vec->x, ' ');
+	writer_int(writer, vec->y, ' ');
+	writer_int(writer, vec->z, '\n');
+}
+
+/*
+ * write_polygon
+ */
+
+static void write_polygon(writer_t *writer, bsp_t *bsp, int p)
+{
+	int i;
+	polygon_t *polygon = &bsp->polygons[p];
+
+	/* idx */
+	writer_string(writer, "polygon ");
+	writer_int(writer, p, '\n');
+
+	/* verts */
+	writer_string(writer, "verts");
+	for (i = 0; i < polygon->num_verts; i++)
+	{
+		writer_string(writer, " ");
+		writer_int(writer, bsp->indices[polygon->first_index + i], 0);
+	}
+	writer_string(writer, "\n");
+
+	/* tname */
+	writer_string(writer, "tname ");
+	writer_string(writer, bsp->textures[polygon->texture].name);
+	writer_string(writer, "\n");
+
+	/* tu, tv, to */
+	writer_string(writer, "tu ");
+	writer_vec3(writer, &polygon->tu);
+	writer_string(writer, "tv ");
+	writer_vec3(writer, &polygon->tv);
+	writer_string(writer, "to ");
+	writer_vec3(writer, &polygon->to);
+}
+
+/*
+ * write_node
+ */
+
+static void write_node(writer_t *writer, node_t *node, int n)
+{
+	/* idx */
+	writer_string(writer, "node ");
+	writer_int(writer, n, '\n');
+
+	/* plane */
+	writer_string(writer, "A ");
+	writer_float(writer, node->a, '\n');
+	writer_string(writer, "B ");
+	writer_float(writer, node->b, '\n');
+	writer_string(writer, "C ");
+	writer_float(writer, node->c, '\n');
+	writer_string(writer, "D ");
+	writer_float(writer, node->d, '\n');
+
+	/* links */
+	writer_string(writer, "inid ");
+	writer_int(writer, node->inid, '\n');
+	writer_string(writer, "outid ");
+	writer_int(writer, node->outid, '\n');
+	writer_string(writer, "front ");
+	writer_int(writer, node->front, '\n');
+	writer_string(writer, "back ");
+	writer_int(writer, node->back, '\n');
+}
+
+/*
+ * bsp_save
+ */
+
+void bsp_save(bsp_t *bsp, const char *filename)
+{
+	/* variables */
+	writer_t writer;
+	int *first, *order;
+	int i, n;
+
+	/* polygons are written under the node they belong to, so bucket */
+	/* them by node first. anything without a valid node goes last, */
+	/* under node -1, which reads back as no node */
+	first = calloc(bsp->num_nodes + 2, sizeof(int));
+	order = malloc((bsp->num_polygons + 1) * sizeof(int));
+	if (first == NULL || order == NULL)
+	{
+		printf("error: failed malloc\n");
+		free(first);
+		free(order);
+		return;
+	}
+	for (i = 0; i < bsp->num_polygons; i++)
+	{
+		n = bsp->polygons[i].node;
+		first[(n >= 0 && n < bsp->num_nodes ? n : bsp->num_nodes) + 1]++;
+	}
+	for (n = 0; n <= bsp->num_nodes; n++)
+		first[n + 1] += first[n];
+	for (i = 0; i < bsp->num_polygons; i++)
+	{
+		n = bsp->polygons[i].node;
+		order[first[n >= 0 && n < bsp->num_nodes ? n : bsp->num_nodes]++] = i;
+	}
+	for (n = bsp->num_nodes; n > 0; n--)
+		first[n] = first[n - 1];
+	first[0] = 0;
+
+	/* open file */
+	writer.file = fopen(filename, "wb");
+	if (writer.file == NULL)
 	{
 		printf("error: failed to open %s for writing\n", filename);
+		free(first);
+		free(order);
+		return;
+	}
+	writer.buffer = malloc(WRITER_LEN);
+	if (writer.buffer == NULL)
+	{
+		printf("error: failed malloc\n");
+		fclose(writer.file);
+		free(first);
+		free(order);
 		return;
 	}
+	writer.len = 0;
+	writer.error = 0;
 
 	/* CAMERA */
-	fprintf(file, "CAMERA\n");
+	writer_string(&writer, "CAMERA\n");
 
 	/* viewpoint */
-	fprintf(file, "viewpoint ");
-	print_vec3(file, &bsp->camera.viewpoint);
-	fprintf(file, "\n");
+	writer_string(&writer, "viewpoint ");
+	writer_vec3(&writer, &bsp->camera.viewpoint);
 
 	/* viewnormal */
-	fprintf(file, "viewnormal ");
-	print_vec3(file, &bsp->camera.viewnormal);
-	fprintf(file, "\n");
+	writer_string(&writer, "viewnormal ");
+	writer_vec3(&writer, &bsp->camera.viewnormal);
 
 	/* viewangle */
-	fprintf(file, "viewangle %d\n", bsp->camera.viewangle);
+	writer_string(&writer, "viewangle ");
+	writer_int(&writer, bsp->camera.viewangle, '\n');
 
 	/* texturelength */
-	fprintf(file, "texturelength %d\n", bsp->camera.texturelength);
+	writer_string(&writer, "texturelength ");
+	writer_int(&writer, bsp->camera.texturelength, '\n');
 
 	/* STRUCTURE */
-	fprintf(file, "STRUCTURE\n");
+	writer_string(&writer, "STRUCTURE\n");
 
 	/* xcomponents */
-	fprintf(file, "xcomponents %d\n", bsp->num_xcomponents);
+	writer_string(&writer, "xcomponents ");
+	writer_int(&writer, bsp->num_xcomponents, '\n');
 	for (i = 0; i < bsp->num_xcomponents; i++)
-		fprintf(file, "%0.6f\n", bsp->xcomponents[i]);
+		writer_float(&writer, bsp->xcomponents[i], '\n');
 
 	/* ycomponents */
-	fprintf(file, "ycomponents %d\n", bsp->num_ycomponents);
+	writer_string(&writer, "ycomponents ");
+	writer_int(&writer, bsp->num_ycomponents, '\n');
 	for (i = 0; i < bsp->num_ycomponents; i++)
-		fprintf(file, "%0.6f\n", bsp->ycomponents[i]);
+		writer_float(&writer, bsp->ycomponents[i], '\n');
 
 	/* zcomponents */
-	fprintf(file, "zcomponents %d\n", bsp->num_zcomponents);
+	writer_string(&writer, "zcomponents ");
+	writer_int(&writer, bsp->num_zcomponents, '\n');
 	for (i = 0; i < bsp->num_zcomponents; i++)
-		fprintf(file, "%0.6f\n", bsp->zcomponents[i]);
+		writer_float(&writer, bsp->zcomponents[i], '\n');
 
 	/* vertices */
-	fprintf(file, "numverts %d\n", bsp->num_vertices);
+	writer_string(&writer, "numverts ");
+	writer_int(&writer, bsp->num_vertices, '\n');
 	for (i = 0; i < bsp->num_vertices; i++)
-	{
-		print_vec3i(file, &bsp->vertices[i]);
-		fprintf(file, "\n");
-	}
+		writer_vec3i(&writer, &bsp->vertices[i]);
 
 	/* numpolys */
-	fprintf(file, "numpolys %d\n", bsp->num_polygons);
+	writer_string(&writer, "numpolys ");
+	writer_int(&writer, bsp->num_polygons, '\n');
 
 	/* BSPTREE */
-	fprintf(file, "BSPTREE\n");
+	writer_string(&writer, "BSPTREE\n");
 
 	/* numnodes */
-	fprintf(file, "numnodes %d\n", bsp->num_nodes);
+	writer_string(&writer, "numnodes ");
+	writer_int(&writer, bsp->num_nodes, '\n');
 
-	/* TODO: nodes and polys */
+	/* nodes and their polys */
+	for (n = 0; n <= bsp->num_nodes; n++)
+	{
+		int nodeless = 0;
+
+		if (n < bsp->num_nodes)
+			write_node(&writer, &bsp->nodes[n], n);
+
+		for (i = first[n]; i < first[n + 1]; i++)
+		{
+			polygon_t *polygon = &bsp->polygons[order[i]];
+
+			/* numpolys covers polygons the tree never defined, leaving */
+			/* them out reads back the same without a bogus tname */
+			if (polygon->num_verts <= 0 || polygon->texture < 0 || polygon->texture >= bsp->num_textures)
+				continue;
+
+			/* just the node token, there's no node to write */
+			if (n == bsp->num_nodes && !nodeless++)
+				writer_string(&writer, "node -1\n");
+
+			write_polygon(&writer, bsp, order[i]);
+		}
+	}
 
 	/* close file */
-	fclose(file);
+	writer_flush(&writer);
+	if (writer.error || ferror(writer.file))
+		printf("error: failed to write %s\n", filename);
+	fclose(writer.file);
+	free(writer.buffer);
+	free(first);
+	free(order);
+}
+
+/*
+ * bsp_save_binary
+ */
+
+void bsp_save_binary(bsp_t *bsp, const char *filename)
+{
+	if (!bsp_write_cache(bsp, filename, 0, 0))
+		printf("error: failed to write %s\n", filename);
 }
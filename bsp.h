@@ -22,9 +22,18 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#ifndef _BSP_H_
+#define _BSP_H_
+
+/* std */
+#include <stdint.h>
+
 /* backend */
 #include "backend.h"
 
+/* file */
+#include "file.h"
+
 /* bsp camera */
 typedef struct
 {
@@ -34,24 +43,35 @@ typedef struct
 	int texturelength;
 } camera_t;
 
-#define TOKEN_STR_LEN 128
+/* lexer */
+typedef struct
+{
+	const char *ptr;
+	const char *end;
+} lexer_t;
 
-/* lexer token */
+/* lexer token (points into the lexer buffer, not terminated) */
 typedef struct
 {
-	char str[TOKEN_STR_LEN];
+	const char *str;
 	int len;
 } token_t;
 
 /* bsp x/y/z component */
 typedef float component_t;
 
+/* bsp texture name */
+typedef struct
+{
+	char name[TEXTURE_NAME_LEN];
+} bsp_texture_t;
+
 /* bsp polygon */
 typedef struct
 {
-	int verts[32];
+	int first_index;
 	int num_verts;
-	char tname[32];
+	int texture;
 	vec3_t tu;
 	vec3_t tv;
 	vec3_t to;
@@ -88,11 +108,93 @@ typedef struct
 	polygon_t *polygons;
 	int num_polygons;
 
+	/* polygon vertex indices */
+	int *indices;
+	int num_indices;
+
+	/* texture names used by polygons */
+	bsp_texture_t *textures;
+	int num_textures;
+
 	node_t *nodes;
 	int num_nodes;
+
+	/* vertex positions from bsp_resolve_positions, if built */
+	float *positions_x;
+	float *positions_y;
+	float *positions_z;
+	vec3_t *positions;
+	void *resolved;
+
+	/* binary bsp image holding the arrays above */
+	struct bsp_header_s *header;
+
+	/* storage for parsed bsps, laid out as a binary bsp */
+	uint8_t *arena;
+	size_t len_arena;
+	size_t max_arena;
+
+	/* mapping owned by this bsp, if any */
+	file_t *file;
 } bsp_t;
 
+/* bsp_resolve_positions flags */
+#define BSP_POSITIONS_SOA (1 << 0)
+#define BSP_POSITIONS_INTERLEAVED (1 << 1)
+
+/* binary bsp cache */
+#define BSP_CACHE_MAGIC "PBSC"
+#define BSP_CACHE_VERSION 3
+#define BSP_CACHE_ALIGN 16
+
+/* binary bsp lumps */
+enum
+{
+	BSP_LUMP_XCOMPONENTS,
+	BSP_LUMP_YCOMPONENTS,
+	BSP_LUMP_ZCOMPONENTS,
+	BSP_LUMP_VERTICES,
+	BSP_LUMP_POLYGONS,
+	BSP_LUMP_NODES,
+	BSP_LUMP_INDICES,
+	BSP_LUMP_TEXTURES,
+	BSP_NUM_LUMPS
+};
+
+/* binary bsp lump */
+typedef struct
+{
+	uint32_t ofs;
+	uint32_t num;
+} bsp_lump_t;
+
+/* binary bsp header */
+typedef struct bsp_header_s
+{
+	char magic[4];
+	int32_t version;
+	uint32_t len;
+	uint64_t len_source;
+	int64_t mtime_source;
+	camera_t camera;
+	bsp_lump_t lumps[BSP_NUM_LUMPS];
+} bsp_header_t;
+
+/* node batch callback, the callee owns the batch and frees it with bsp_free */
+typedef void (*bsp_batch_func_t)(bsp_t *batch, void *arg);
+
+/* polled while parsing text, nonzero gives up and returns NULL */
+typedef int (*bsp_abort_func_t)(void *arg);
+
 /* function prototypes */
 bsp_t *bsp_read(const char *filename);
+bsp_t *bsp_from_buffer(const void *buffer, size_t buffer_len);
 void bsp_free(bsp_t *bsp);
+void bsp_set_threads(int num_threads);
+void bsp_set_batch_func(bsp_batch_func_t func, void *arg);
+void bsp_set_abort_func(bsp_abort_func_t func, void *arg);
 void bsp_save(bsp_t *bsp, const char *filename);
+void bsp_save_binary(bsp_t *bsp, const char *filename);
+int bsp_resolve_positions(bsp_t *bsp, int flags);
+
+#endif /* _BSP_H_ */
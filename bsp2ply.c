@@ -49,19 +49,38 @@ SOFTWARE.
  * main
  */
 
-int main(void)
+int main(int argc, char *argv[])
 {
 	/* variables */
 	bsp_t *bsp;
 	int i, v;
 	FILE *ply;
+	const char *filename = "DEMO4.BSP";
+	char *plyname;
+
+	/* check if user specified options */
+	for (i = 1; i < argc; i++)
+	{
+		/* bsp */
+		if (strcmp(argv[i], "--bsp") == 0 && i + 1 < argc)
+			filename = argv[i + 1];
+
+		/* parser threads */
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			bsp_set_threads(atoi(argv[i + 1]));
+	}
 
 	/* read bsp */
-	bsp = bsp_read("DEMO4.BSP");
+	bsp = bsp_read(filename);
 	if (!bsp) return 1;
+	if (!bsp_resolve_positions(bsp, BSP_POSITIONS_SOA)) return 1;
 
 	/* write ply */
-	ply = fopen("DEMO4.BSP.ply", "wb");
+	plyname = malloc(strlen(filename) + 5);
+	if (!plyname) return 1;
+	sprintf(plyname, "%s.ply", filename);
+	ply = fopen(plyname, "wb");
+	free(plyname);
 	if (!ply) return 1;
 
 	/* write header */
@@ -76,9 +95,9 @@ int main(void)
 	for (i = 0; i < bsp->num_vertices; i++)
 	{
 		fprintf(ply, "%0.6f %0.6f %0.6f\n",
-			bsp->xcomponents[bsp->vertices[i].x],
-			bsp->ycomponents[bsp->vertices[i].y],
-			bsp->zcomponents[bsp->vertices[i].z]
+			bsp->positions_x[i],
+			bsp->positions_y[i],
+			bsp->positions_z[i]
 		);
 	}
 
@@ -89,7 +108,7 @@ int main(void)
 
 		for (v = 0; v < bsp->polygons[i].num_verts; v++)
 		{
-			fprintf(ply, " %d", bsp->polygons[i].verts[v]);
+			fprintf(ply, " %d", bsp->indices[bsp->polygons[i].first_index + v]);
 		}
 
 		fprintf(ply, "\n");
@@ -0,0 +1,516 @@
+/*
+MIT License
+
+Copyright (c) 2023 erysdren (it/she/they)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ *
+ * headers
+ *
+ */
+
+/* std */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* crc */
+#include "crc.h"
+
+/* bundle */
+#include "bundle.h"
+
+/*
+ *
+ * functions
+ *
+ */
+
+/*
+ * bundle_align
+ */
+
+static uint64_t bundle_align(uint64_t ofs)
+{
+	return (ofs + BUNDLE_ALIGN - 1) & ~(uint64_t)(BUNDLE_ALIGN - 1);
+}
+
+/*
+ * bundle_len_pixels
+ */
+
+static uint64_t bundle_len_pixels(int width, int height, int num_levels, int bpp)
+{
+	uint64_t len = 0;
+
+	/* levels are stored back to back, biggest first */
+	while (num_levels--)
+	{
+		len += (uint64_t)width * height * bpp;
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+
+	return len;
+}
+
+/*
+ * bundle_hash_file
+ */
+
+static int bundle_hash_file(const char *filename, uint32_t *crc)
+{
+	file_t *file;
+	uint64_t len;
+
+	file = file_map(filename);
+	if (file == NULL)
+		return 0;
+
+	/* the length keeps files from running into each other */
+	len = file->len;
+	*crc = crc32c(*crc, &len, sizeof(len));
+	*crc = crc32c(*crc, file->data, file->len);
+
+	file_unmap(file);
+
+	return 1;
+}
+
+/*
+ * bundle_key
+ */
+
+int bundle_key(const char *bsp_filename, const char **wad_filenames, int num_wads, uint32_t flags, float scale, uint32_t *key)
+{
+	uint32_t crc = 0;
+	int i;
+
+	/* what the bundle was built with */
+	crc = crc32c(crc, &flags, sizeof(flags));
+	crc = crc32c(crc, &scale, sizeof(scale));
+
+	/* and from */
+	if (!bundle_hash_file(bsp_filename, &crc))
+		return 0;
+	for (i = 0; i < num_wads; i++)
+	{
+		if (!bundle_hash_file(wad_filenames[i], &crc))
+			return 0;
+	}
+
+	*key = crc;
+
+	return 1;
+}
+
+/*
+ * bundle_stamp_file
+ */
+
+static uint32_t bundle_stamp_file(const char *filename, uint32_t crc)
+{
+	int64_t mtime = 0;
+	size_t len = 0;
+	uint64_t len64;
+
+	/* a missing file stamps as zero */
+	file_stat(filename, &mtime, &len);
+	len64 = len;
+	crc = crc32c(crc, &mtime, sizeof(mtime));
+	crc = crc32c(crc, &len64, sizeof(len64));
+
+	return crc;
+}
+
+/*
+ * bundle_stamp
+ */
+
+uint32_t bundle_stamp(const char *bsp_filename, const char **wad_filenames, int num_wads)
+{
+	uint32_t crc;
+	int i;
+
+	/* cheap check that nothing was written since the key was taken */
+	crc = bundle_stamp_file(bsp_filename, 0);
+	for (i = 0; i < num_wads; i++)
+		crc = bundle_stamp_file(wad_filenames[i], crc);
+
+	return crc;
+}
+
+/*
+ * bundle_check
+ */
+
+static int bundle_check(bundle_header_t *header, uint64_t ofs, int32_t num, size_t size)
+{
+	return ofs % BUNDLE_ALIGN == 0 &&
+		num >= 0 &&
+		ofs <= header->len &&
+		(uint64_t)num * size <= header->len - ofs;
+}
+
+/*
+ * bundle_valid
+ */
+
+static int bundle_valid(bundle_t *bundle)
+{
+	bundle_header_t *header = bundle->header;
+	int bpp = (header->flags & BUNDLE_INDEXED) ? 1 : 3;
+	int i;
+
+	/* triangles must stay inside the vertices */
+	for (i = 0; i < header->num_triangles; i++)
+	{
+		vec3i_t *triangle = &bundle->triangles[i];
+		if ((uint32_t)triangle->x >= (uint32_t)header->num_vertices ||
+			(uint32_t)triangle->y >= (uint32_t)header->num_vertices ||
+			(uint32_t)triangle->z >= (uint32_t)header->num_vertices)
+			return 0;
+	}
+
+	/* ranges inside the triangles */
+	for (i = 0; i < header->num_ranges; i++)
+	{
+		bundle_range_t *range = &bundle->ranges[i];
+		if (range->first_triangle < 0 || range->num_triangles < 0 ||
+			range->first_triangle > header->num_triangles - range->num_triangles)
+			return 0;
+	}
+
+	/* and pixels inside the file */
+	for (i = 0; i < header->num_textures; i++)
+	{
+		bundle_texture_t *texture = &bundle->textures[i];
+		if (texture->range < 0 || texture->range >= header->num_ranges ||
+			texture->width <= 0 || texture->height <= 0 ||
+			texture->width > 4096 || texture->height > 4096 ||
+			texture->num_levels <= 0 || texture->num_levels > 13 ||
+			texture->len != bundle_len_pixels(texture->width, texture->height, texture->num_levels, bpp) ||
+			texture->ofs > header->len || texture->len > header->len - texture->ofs)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * bundle_open
+ */
+
+bundle_t *bundle_open(const char *filename, uint32_t key, uint32_t flags)
+{
+	/* variables */
+	bundle_t *bundle;
+	bundle_header_t *header;
+	file_t *file;
+
+	/* a missing or stale bundle just gets rebuilt */
+	file = file_map(filename);
+	if (file == NULL)
+		return NULL;
+
+	header = (bundle_header_t *)file->data;
+	if (file->len < sizeof(bundle_header_t) ||
+		(uintptr_t)file->data % BUNDLE_ALIGN ||
+		memcmp(header->magic, BUNDLE_MAGIC, 4) != 0 ||
+		header->version != BUNDLE_VERSION ||
+		header->key != key ||
+		header->flags != flags ||
+		header->len != file->len)
+	{
+		file_unmap(file);
+		return NULL;
+	}
+
+	/* check sections */
+	if (!bundle_check(header, header->ofs_vertices, header->num_vertices, sizeof(gl_vertex_t)) ||
+		!bundle_check(header, header->ofs_triangles, header->num_triangles, sizeof(vec3i_t)) ||
+		!bundle_check(header, header->ofs_ranges, header->num_ranges, sizeof(bundle_range_t)) ||
+		!bundle_check(header, header->ofs_textures, header->num_textures, sizeof(bundle_texture_t)))
+	{
+		printf("error: corrupt bundle %s\n", filename);
+		file_unmap(file);
+		return NULL;
+	}
+
+	/* alloc */
+	bundle = calloc(1, sizeof(bundle_t));
+	if (bundle == NULL)
+	{
+		printf("error: failed malloc\n");
+		file_unmap(file);
+		return NULL;
+	}
+
+	/* point arrays into the file */
+	bundle->file = file;
+	bundle->header = header;
+	bundle->vertices = (gl_vertex_t *)((uint8_t *)file->data + header->ofs_vertices);
+	bundle->triangles = (vec3i_t *)((uint8_t *)file->data + header->ofs_triangles);
+	bundle->ranges = (bundle_range_t *)((uint8_t *)file->data + header->ofs_ranges);
+	bundle->textures = (bundle_texture_t *)((uint8_t *)file->data + header->ofs_textures);
+
+	if (!bundle_valid(bundle))
+	{
+		printf("error: corrupt bundle %s\n", filename);
+		bundle_free(bundle);
+		return NULL;
+	}
+
+	return bundle;
+}
+
+/*
+ * bundle_mesh
+ */
+
+gl_mesh_t *bundle_mesh(bundle_t *bundle)
+{
+	/* variables */
+	gl_mesh_t *mesh;
+	int i;
+
+	/* alloc */
+	mesh = calloc(1, sizeof(gl_mesh_t));
+	if (mesh == NULL)
+	{
+		printf("error: failed malloc\n");
+		return NULL;
+	}
+
+	/* buffers stay in the bundle and go up as they are */
+	mesh->interleaved = bundle->vertices;
+	mesh->num_vertices = bundle->header->num_vertices;
+	mesh->triangles = bundle->triangles;
+	mesh->num_triangles = bundle->header->num_triangles;
+
+	/* ranges get their own copy, they pick up texture ids */
+	mesh->num_textures = bundle->header->num_ranges;
+	mesh->textures = calloc(mesh->num_textures, sizeof(gl_texture_t));
+	if (mesh->textures == NULL)
+	{
+		printf("error: failed malloc\n");
+		free(mesh);
+		return NULL;
+	}
+
+	for (i = 0; i < mesh->num_textures; i++)
+	{
+		memcpy(mesh->textures[i].name, bundle->ranges[i].name, sizeof(mesh->textures[i].name) - 1);
+		mesh->textures[i].first_triangle = bundle->ranges[i].first_triangle;
+		mesh->textures[i].num_triangles = bundle->ranges[i].num_triangles;
+	}
+
+	return mesh;
+}
+
+/*
+ * bundle_pixels
+ */
+
+uint8_t *bundle_pixels(bundle_t *bundle, int texture)
+{
+	return (uint8_t *)bundle->file->data + bundle->textures[texture].ofs;
+}
+
+/*
+ * bundle_pad
+ */
+
+static void bundle_pad(FILE *file, uint64_t *ofs)
+{
+	static const uint8_t zero[BUNDLE_ALIGN];
+	uint64_t aligned = bundle_align(*ofs);
+
+	fwrite(zero, aligned - *ofs, 1, file);
+	*ofs = aligned;
+}
+
+/*
+ * bundle_write
+ */
+
+int bundle_write(const char *filename, uint32_t key, uint32_t flags, gl_mesh_t *mesh, gl_texture_t **textures, const uint8_t *palette, vec3_t viewpoint)
+{
+	/* variables */
+	FILE *file;
+	bundle_header_t header;
+	bundle_range_t range;
+	bundle_texture_t texture;
+	gl_vertex_t vertices[1024];
+	char *tempname;
+	uint64_t ofs;
+	int bpp = (flags & BUNDLE_INDEXED) ? 1 : 3;
+	int i, j, n;
+
+	/* lay it out */
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BUNDLE_MAGIC, 4);
+	header.version = BUNDLE_VERSION;
+	header.key = key;
+	header.flags = flags;
+	header.viewpoint = viewpoint;
+	header.num_vertices = mesh->num_vertices;
+	header.num_triangles = mesh->num_triangles;
+	header.num_ranges = mesh->num_textures;
+	memcpy(header.palette, palette, sizeof(header.palette));
+
+	for (i = 0; i < mesh->num_textures; i++)
+	{
+		if (textures[i])
+			header.num_textures++;
+	}
+
+	header.ofs_vertices = bundle_align(sizeof(bundle_header_t));
+	header.ofs_triangles = bundle_align(header.ofs_vertices + (uint64_t)header.num_vertices * sizeof(gl_vertex_t));
+	header.ofs_ranges = bundle_align(header.ofs_triangles + (uint64_t)header.num_triangles * sizeof(vec3i_t));
+	header.ofs_textures = bundle_align(header.ofs_ranges + (uint64_t)header.num_ranges * sizeof(bundle_range_t));
+	ofs = bundle_align(header.ofs_textures + (uint64_t)header.num_textures * sizeof(bundle_texture_t));
+	for (i = 0; i < mesh->num_textures; i++)
+	{
+		if (textures[i])
+			ofs = bundle_align(ofs + bundle_len_pixels(textures[i]->width, textures[i]->height, textures[i]->num_levels, bpp));
+	}
+	header.len = ofs;
+
+	/* write next to it, then swap it in */
+	tempname = malloc(strlen(filename) + 2);
+	if (tempname == NULL)
+		return 0;
+	sprintf(tempname, "%s~", filename);
+
+	/* open file */
+	file = fopen(tempname, "wb");
+	if (file == NULL)
+	{
+		free(tempname);
+		return 0;
+	}
+
+	/* write header */
+	fwrite(&header, sizeof(bundle_header_t), 1, file);
+	ofs = sizeof(bundle_header_t);
+	bundle_pad(file, &ofs);
+
+	/* write vertices, interleaved the way upload_mesh would */
+	for (i = 0; i < mesh->num_vertices; i += n)
+	{
+		n = mesh->num_vertices - i < 1024 ? mesh->num_vertices - i : 1024;
+		memset(vertices, 0, n * sizeof(gl_vertex_t));
+		for (j = 0; j < n; j++)
+		{
+			vertices[j].position = mesh->vertices[i + j];
+			vertices[j].texcoord = mesh->texcoords[i + j];
+		}
+		fwrite(vertices, sizeof(gl_vertex_t), n, file);
+	}
+	ofs += (uint64_t)mesh->num_vertices * sizeof(gl_vertex_t);
+	bundle_pad(file, &ofs);
+
+	/* write triangles */
+	fwrite(mesh->triangles, sizeof(vec3i_t), mesh->num_triangles, file);
+	ofs += (uint64_t)mesh->num_triangles * sizeof(vec3i_t);
+	bundle_pad(file, &ofs);
+
+	/* write ranges */
+	for (i = 0; i < mesh->num_textures; i++)
+	{
+		memset(&range, 0, sizeof(range));
+		memcpy(range.name, mesh->textures[i].name, sizeof(range.name) - 1);
+		range.first_triangle = mesh->textures[i].first_triangle;
+		range.num_triangles = mesh->textures[i].num_triangles;
+		fwrite(&range, sizeof(bundle_range_t), 1, file);
+	}
+	ofs += (uint64_t)mesh->num_textures * sizeof(bundle_range_t);
+	bundle_pad(file, &ofs);
+
+	/* write texture table, pixels follow it in the same order */
+	texture.ofs = bundle_align(ofs + (uint64_t)header.num_textures * sizeof(bundle_texture_t));
+	texture.len = 0;
+	for (i = 0; i < mesh->num_textures; i++)
+	{
+		if (!textures[i])
+			continue;
+
+		texture.ofs = bundle_align(texture.ofs + texture.len);
+		texture.range = i;
+		texture.width = textures[i]->width;
+		texture.height = textures[i]->height;
+		texture.num_levels = textures[i]->num_levels;
+		texture.len = bundle_len_pixels(texture.width, texture.height, texture.num_levels, bpp);
+		fwrite(&texture, sizeof(bundle_texture_t), 1, file);
+	}
+	ofs += (uint64_t)header.num_textures * sizeof(bundle_texture_t);
+	bundle_pad(file, &ofs);
+
+	/* write pixels */
+	for (i = 0; i < mesh->num_textures; i++)
+	{
+		if (!textures[i])
+			continue;
+
+		n = (int)bundle_len_pixels(textures[i]->width, textures[i]->height, textures[i]->num_levels, bpp);
+		fwrite(textures[i]->pixels, n, 1, file);
+		ofs += n;
+		bundle_pad(file, &ofs);
+	}
+
+	/* close file */
+	if (ferror(file) || ofs != header.len)
+	{
+		fclose(file);
+		remove(tempname);
+		free(tempname);
+		return 0;
+	}
+	fclose(file);
+
+	remove(filename);
+	if (rename(tempname, filename) != 0)
+	{
+		remove(tempname);
+		free(tempname);
+		return 0;
+	}
+
+	free(tempname);
+
+	return 1;
+}
+
+/*
+ * bundle_free
+ */
+
+void bundle_free(bundle_t *bundle)
+{
+	if (bundle)
+	{
+		file_unmap(bundle->file);
+		free(bundle);
+	}
+}
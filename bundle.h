@@ -0,0 +1,105 @@
+/*
+MIT License
+
+Copyright (c) 2023 erysdren (it/she/they)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _BUNDLE_H_
+#define _BUNDLE_H_
+
+/* std */
+#include <stdint.h>
+
+/* backend */
+#include "backend.h"
+
+/* file */
+#include "file.h"
+
+/* bundle file */
+#define BUNDLE_MAGIC "PGLB"
+#define BUNDLE_VERSION 2
+#define BUNDLE_ALIGN 16
+
+/* bundle flags, anything that changes what gets built */
+#define BUNDLE_INDEXED (1 << 0)
+#define BUNDLE_MIPMAPS (1 << 1)
+
+/* mesh texture range */
+typedef struct
+{
+	char name[TEXTURE_NAME_LEN];
+	int32_t first_triangle;
+	int32_t num_triangles;
+} bundle_range_t;
+
+/* texture ready for upload, every level back to back */
+typedef struct
+{
+	int32_t range;
+	int32_t width;
+	int32_t height;
+	int32_t num_levels;
+	uint64_t ofs;
+	uint64_t len;
+} bundle_texture_t;
+
+/* bundle header */
+typedef struct
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t key;
+	uint32_t flags;
+	uint64_t len;
+	vec3_t viewpoint;
+	int32_t num_vertices;
+	int32_t num_triangles;
+	int32_t num_ranges;
+	int32_t num_textures;
+	uint64_t ofs_vertices;
+	uint64_t ofs_triangles;
+	uint64_t ofs_ranges;
+	uint64_t ofs_textures;
+	uint8_t palette[768];
+} bundle_header_t;
+
+/* mapped bundle */
+typedef struct
+{
+	file_t *file;
+	bundle_header_t *header;
+	gl_vertex_t *vertices;
+	vec3i_t *triangles;
+	bundle_range_t *ranges;
+	bundle_texture_t *textures;
+} bundle_t;
+
+/* function prototypes */
+int bundle_key(const char *bsp_filename, const char **wad_filenames, int num_wads, uint32_t flags, float scale, uint32_t *key);
+uint32_t bundle_stamp(const char *bsp_filename, const char **wad_filenames, int num_wads);
+bundle_t *bundle_open(const char *filename, uint32_t key, uint32_t flags);
+gl_mesh_t *bundle_mesh(bundle_t *bundle);
+uint8_t *bundle_pixels(bundle_t *bundle, int texture);
+int bundle_write(const char *filename, uint32_t key, uint32_t flags, gl_mesh_t *mesh, gl_texture_t **textures, const uint8_t *palette, vec3_t viewpoint);
+void bundle_free(bundle_t *bundle);
+
+#endif /* _BUNDLE_H_ */
@@ -0,0 +1,195 @@
+/*
+MIT License
+
+Copyright (c) 2023 erysdren (it/she/they)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ *
+ * headers
+ *
+ */
+
+/* std */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* threads */
+#include <pthread.h>
+
+/* simd, picked at runtime */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC_X86 1
+#include <immintrin.h>
+#else
+#define CRC_X86 0
+#endif
+
+/* crc */
+#include "crc.h"
+
+/*
+ *
+ * types
+ *
+ */
+
+/* checksum kernel, takes and returns the inverted crc */
+typedef uint32_t (*crc_func_t)(uint32_t crc, const uint8_t *data, size_t len);
+
+/*
+ *
+ * globals
+ *
+ */
+
+static uint32_t crc_table[8][256];
+static crc_func_t kernel = NULL;
+static const char *kernel_name = "scalar";
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+/*
+ *
+ * functions
+ *
+ */
+
+/*
+ * crc32c_scalar
+ */
+
+static uint32_t crc32c_scalar(uint32_t crc, const uint8_t *data, size_t len)
+{
+	uint32_t lo, hi;
+
+	/* eight bytes per step, one table each */
+	for (; len >= 8; data += 8, len -= 8)
+	{
+		lo = crc ^ ((uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24);
+		hi = (uint32_t)data[4] | (uint32_t)data[5] << 8 | (uint32_t)data[6] << 16 | (uint32_t)data[7] << 24;
+		crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF] ^
+			crc_table[5][(lo >> 16) & 0xFF] ^ crc_table[4][lo >> 24] ^
+			crc_table[3][hi & 0xFF] ^ crc_table[2][(hi >> 8) & 0xFF] ^
+			crc_table[1][(hi >> 16) & 0xFF] ^ crc_table[0][hi >> 24];
+	}
+
+	while (len--)
+		crc = crc_table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+
+	return crc;
+}
+
+#if CRC_X86
+
+/*
+ * crc32c_sse42
+ */
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, size_t len)
+{
+#ifdef __x86_64__
+	uint64_t crc64 = crc, word;
+
+	for (; len >= 8; data += 8, len -= 8)
+	{
+		memcpy(&word, data, 8);
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+	crc = (uint32_t)crc64;
+#else
+	uint32_t word;
+
+	for (; len >= 4; data += 4, len -= 4)
+	{
+		memcpy(&word, data, 4);
+		crc = _mm_crc32_u32(crc, word);
+	}
+#endif
+
+	while (len--)
+		crc = _mm_crc32_u8(crc, *data++);
+
+	return crc;
+}
+
+#endif
+
+/*
+ * crc32c_select
+ */
+
+static void crc32c_select(void)
+{
+	uint32_t crc;
+	int i, j;
+
+	/* castagnoli polynomial, reflected */
+	for (i = 0; i < 256; i++)
+	{
+		crc = (uint32_t)i;
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1)));
+		crc_table[0][i] = crc;
+	}
+	for (i = 0; i < 256; i++)
+	{
+		for (j = 1; j < 8; j++)
+			crc_table[j][i] = (crc_table[j - 1][i] >> 8) ^ crc_table[0][crc_table[j - 1][i] & 0xFF];
+	}
+
+	kernel = crc32c_scalar;
+
+#if CRC_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("sse4.2"))
+	{
+		kernel = crc32c_sse42;
+		kernel_name = "sse4.2";
+	}
+#endif
+}
+
+/*
+ * crc32c
+ */
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len)
+{
+	pthread_once(&kernel_once, crc32c_select);
+
+	/* pass the previous result back in to continue it */
+	return ~kernel(~crc, (const uint8_t *)data, len);
+}
+
+/*
+ * crc32c_kernel
+ */
+
+const char *crc32c_kernel(void)
+{
+	pthread_once(&kernel_once, crc32c_select);
+
+	return kernel_name;
+}
@@ -0,0 +1,209 @@
+/*
+MIT License
+
+Copyright (c) 2023 erysdren (it/she/they)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ *
+ * headers
+ *
+ */
+
+/* posix */
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+/* std */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* stat */
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/* mmap */
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* file */
+#include "file.h"
+
+/*
+ *
+ * functions
+ *
+ */
+
+/*
+ * file_read
+ */
+
+file_t *file_read(const char *filename)
+{
+	/* variables */
+	FILE *stream;
+	file_t *file;
+	long len;
+
+	/* open file */
+	stream = fopen(filename, "rb");
+	if (stream == NULL)
+		return NULL;
+
+	/* get length */
+	fseek(stream, 0L, SEEK_END);
+	len = ftell(stream);
+	fseek(stream, 0L, SEEK_SET);
+	if (len < 0)
+	{
+		fclose(stream);
+		return NULL;
+	}
+
+	/* alloc */
+	file = calloc(1, sizeof(file_t));
+	if (file == NULL)
+	{
+		fclose(stream);
+		return NULL;
+	}
+
+	/* read contents */
+	file->len = (size_t)len;
+	if (file->len)
+	{
+		file->data = malloc(file->len);
+		if (file->data == NULL || fread(file->data, file->len, 1, stream) != 1)
+		{
+			fclose(stream);
+			free(file->data);
+			free(file);
+			return NULL;
+		}
+	}
+
+	/* close file */
+	fclose(stream);
+
+	return file;
+}
+
+/*
+ * file_map
+ */
+
+file_t *file_map(const char *filename)
+{
+#ifndef _WIN32
+	/* variables */
+	int fd;
+	struct stat st;
+	void *data;
+	file_t *file;
+
+	/* open file */
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	/* empty files or files we can't map get read instead */
+	if (fstat(fd, &st) != 0 || st.st_size <= 0)
+	{
+		close(fd);
+		return file_read(filename);
+	}
+
+	/* map, read only so a stray store faults, file_read gives a copy to write to */
+	data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return file_read(filename);
+
+	/* alloc */
+	file = calloc(1, sizeof(file_t));
+	if (file == NULL)
+	{
+		munmap(data, (size_t)st.st_size);
+		return NULL;
+	}
+
+	file->data = data;
+	file->len = (size_t)st.st_size;
+	file->mapped = 1;
+
+	return file;
+#else
+	return file_read(filename);
+#endif
+}
+
+/*
+ * file_unmap
+ */
+
+void file_unmap(file_t *file)
+{
+	if (file)
+	{
+#ifndef _WIN32
+		if (file->mapped)
+			munmap(file->data, file->len);
+		else if (file->data)
+			free(file->data);
+#else
+		if (file->data)
+			free(file->data);
+#endif
+
+		free(file);
+	}
+}
+
+/*
+ * file_stat
+ */
+
+int file_stat(const char *filename, int64_t *mtime, size_t *len)
+{
+	struct stat st;
+
+	if (stat(filename, &st) != 0)
+		return 0;
+
+	/* nanoseconds, where the filesystem keeps them */
+#if defined(_WIN32)
+	if (mtime) *mtime = (int64_t)st.st_mtime * 1000000000;
+#elif defined(__APPLE__)
+	if (mtime) *mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+	if (mtime) *mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+	if (len) *len = (size_t)st.st_size;
+
+	return 1;
+}
@@ -36,6 +36,10 @@ SOFTWARE.
 #include <math.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdarg.h>
+
+/* threads */
+#include <pthread.h>
 
 /* sdl2 */
 #define SDL_MAIN_HANDLED
@@ -53,6 +57,12 @@ SOFTWARE.
 #include "wad.h"
 #include "mip.h"
 #include "bsp.h"
+#include "mesh.h"
+#include "atlas.h"
+#include "palette.h"
+#include "pool.h"
+#include "bundle.h"
+#include "hash.h"
 
 /*
  *
@@ -63,6 +73,88 @@ SOFTWARE.
 /* level scale */
 #define SCALE (1.0f/1024.0f)
 
+/* decoded textures uploaded per frame while loading */
+#define UPLOADS_PER_FRAME 8
+
+/* node batches meshing or waiting for upload, the parser waits past this */
+#define BATCH_QUEUE_LEN 16
+
+/* batch meshes uploaded per frame while parsing */
+#define BATCHES_PER_FRAME 8
+
+/*
+ *
+ * types
+ *
+ */
+
+/* decoded texture waiting for upload */
+typedef struct loaded_s
+{
+	gl_texture_t texture;
+	int bsp_texture;
+	struct loaded_s *next;
+} loaded_t;
+
+/* texture decode job */
+typedef struct
+{
+	int bsp_texture;
+	wad_t *wad;
+	wad_lump_t *lump;
+} decode_t;
+
+/* node batch meshing or waiting for upload */
+typedef struct
+{
+	bsp_t *batch;
+	gl_mesh_t *mesh;
+	bool meshed;
+} chunk_t;
+
+/* background loader */
+typedef struct
+{
+	/* inputs */
+	const char *bsp_filename;
+	const char **wad_filenames;
+	int num_wads;
+
+	/* results, valid once ready */
+	bsp_t *bsp;
+	gl_mesh_t *mesh;
+	vec3_t viewpoint;
+	wad_t **wads;
+	wad_index_t *index;
+	uint8_t *palette;
+	palette_t expanded;
+	char failure[256];
+
+	/* everything above in one file, keyed on the source bytes */
+	char *bundle_filename;
+	bundle_t *bundle;
+	uint32_t key;
+	uint32_t stamp; /* sizes and mtimes when the key was taken */
+	bool keyed;
+
+	/* everything below is guarded by the mutex */
+	pool_t *pool;
+	pthread_mutex_t mutex;
+	pthread_cond_t signal;
+	int num_jobs; /* bsp and wad jobs still running */
+	bool wads_ready;
+	bool ready;
+	bool quit;
+	int num_decoding; /* queued and not yet uploaded */
+	loaded_t *head;
+	loaded_t *tail;
+
+	/* node batches from the parser, a ring in parse order */
+	chunk_t chunks[BATCH_QUEUE_LEN];
+	int first_chunk; /* oldest, shown first */
+	int num_batches; /* meshing or waiting for upload */
+} loader_t;
+
 /*
  *
  * globals
@@ -70,11 +162,32 @@ SOFTWARE.
  */
 
 /* gl */
-GLint gl_bsp;
-gl_texture_t gl_textures[128];
+gl_mesh_t *gl_mesh = NULL;
+gl_texture_t *gl_textures = NULL;
 int num_gl_textures = 0;
+int max_gl_textures = 0;
+int *gl_texture_table = NULL; /* texture + 1, zero is empty */
+int len_gl_texture_table = 0;
+GLuint gl_placeholder = 0;
+gl_texture_t placeholder;
+uint8_t placeholder_pixels[(64 + 16 + 4 + 1) * 3];
+atlas_t *gl_atlas = NULL;
+bool use_atlas = false;
+bool use_indexed = false;
+bool use_mipmaps = true;
+uint8_t *wad_palette = NULL;
+GLuint gl_palette = 0;
 bool wireframe = false;
 
+/* background loading */
+loader_t loader;
+
+/* meshes for node batches, drawn until the whole map is ready */
+gl_mesh_t **gl_chunks = NULL;
+int num_gl_chunks = 0;
+int max_gl_chunks = 0;
+bool camera_placed = false;
+
 /*
  *
  * functions
@@ -82,167 +195,1294 @@ bool wireframe = false;
  */
 
 /*
- * find_texture
+ * count_levels
+ */
+
+int count_levels(int width, int height)
+{
+	int n = 1;
+
+	while (width > 1 || height > 1)
+	{
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+		n++;
+	}
+
+	return n;
+}
+
+/*
+ * texture_level
  */
 
-int find_texture(char *s)
+uint8_t *texture_level(uint8_t *pixels, int width, int height, int bpp, int level)
 {
+	/* levels are stored back to back, biggest first */
+	while (level--)
+	{
+		pixels += width * height * bpp;
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+
+	return pixels;
+}
+
+/*
+ * generate_level
+ */
+
+void generate_level(gl_texture_t *texture, int level)
+{
+	int bpp = use_indexed ? 1 : 3;
+	int width = texture->width, height = texture->height;
+	uint8_t *src, *dst;
+
+	src = texture_level(texture->pixels, width, height, bpp, level - 1);
+	dst = texture_level(texture->pixels, width, height, bpp, level);
+
+	/* size of the level above */
+	while (--level)
+	{
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+
+	if (use_indexed)
+		mip_decimate(src, width, height, bpp, dst);
+	else
+		mip_downsample(src, width, height, bpp, dst);
+}
+
+/*
+ * upload_texture
+ */
+
+void upload_texture(gl_texture_t *texture)
+{
+	int bpp = use_indexed ? 1 : 3;
+	int level, width = texture->width, height = texture->height;
+
+	glGenTextures(1, &texture->id);
+	glBindTexture(GL_TEXTURE_2D, texture->id);
+
+	for (level = 0; level < texture->num_levels; level++)
+	{
+		uint8_t *pixels = texture_level(texture->pixels, texture->width, texture->height, bpp, level);
+
+		if (use_indexed)
+			glTexImage2D(GL_TEXTURE_2D, level, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, pixels);
+		else
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+
+	/* indices can't be blended between levels either */
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture->num_levels - 1);
+	if (texture->num_levels > 1)
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, use_indexed ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST_MIPMAP_LINEAR);
+	else
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+}
+
+/*
+ * nearest_color
+ */
+
+uint8_t nearest_color(int r, int g, int b)
+{
+	int i, best = 0, best_dist = 0x7FFFFFFF;
+
+	for (i = 0; i < 256; i++)
+	{
+		int dr = wad_palette[i * 3] - r;
+		int dg = wad_palette[(i * 3) + 1] - g;
+		int db = wad_palette[(i * 3) + 2] - b;
+		int dist = dr * dr + dg * dg + db * db;
+		if (dist < best_dist)
+		{
+			best = i;
+			best_dist = dist;
+		}
+	}
+
+	return (uint8_t)best;
+}
+
+/*
+ * make_placeholder
+ */
+
+GLuint make_placeholder(void)
+{
+	uint8_t *pixels = placeholder_pixels;
+	int x, y, level;
+
+	/* magenta and black checkerboard */
+	for (y = 0; y < 8; y++)
+	{
+		for (x = 0; x < 8; x++)
+		{
+			uint8_t c = ((x ^ y) & 4) ? 255 : 0;
+			if (use_indexed)
+			{
+				pixels[(y * 8) + x] = nearest_color(c, 0, c);
+				continue;
+			}
+			pixels[((y * 8) + x) * 3] = c;
+			pixels[(((y * 8) + x) * 3) + 1] = 0;
+			pixels[(((y * 8) + x) * 3) + 2] = c;
+		}
+	}
+
+	placeholder.width = 8;
+	placeholder.height = 8;
+	placeholder.pixels = pixels;
+	placeholder.num_levels = use_mipmaps ? count_levels(8, 8) : 1;
+	for (level = 1; level < placeholder.num_levels; level++)
+		generate_level(&placeholder, level);
+
+	upload_texture(&placeholder);
+
+	return placeholder.id;
+}
+
+/*
+ * insert_texture
+ */
+
+void insert_texture(int texture)
+{
+	int mask = len_gl_texture_table - 1;
+	int i = hash_fnv1a_string(gl_textures[texture].name) & mask;
+
+	while (gl_texture_table[i])
+		i = (i + 1) & mask;
+
+	gl_texture_table[i] = texture + 1;
+}
+
+/*
+ * register_texture
+ */
+
+gl_texture_t *register_texture(const char *name)
+{
+	gl_texture_t *texture;
 	int i;
 
-	for (i = 0; i < num_gl_textures; i++)
+	/* grow, keeping the table at most half full */
+	if (num_gl_textures >= max_gl_textures)
 	{
-		if (strcmp(gl_textures[i].name, s) == 0)
-			return gl_textures[i].id;
+		max_gl_textures = max_gl_textures ? max_gl_textures * 2 : 64;
+		gl_textures = realloc(gl_textures, max_gl_textures * sizeof(gl_texture_t));
+		if (gl_textures == NULL)
+			error("failed malloc");
+
+		free(gl_texture_table);
+		len_gl_texture_table = max_gl_textures * 2;
+		gl_texture_table = calloc(len_gl_texture_table, sizeof(int));
+		if (gl_texture_table == NULL)
+			error("failed malloc");
+
+		for (i = 0; i < num_gl_textures; i++)
+			insert_texture(i);
 	}
 
-	error("couldn't find texture %s\n", s);
+	texture = &gl_textures[num_gl_textures];
+	memset(texture, 0, sizeof(gl_texture_t));
+	strncpy(texture->name, name, sizeof(texture->name) - 1);
+	insert_texture(num_gl_textures++);
 
-	return -1;
+	return texture;
 }
 
 /*
- * process_bsp
+ * lookup_texture
  */
 
-void process_bsp(bsp_t *bsp)
+gl_texture_t *lookup_texture(const char *s)
+{
+	int mask = len_gl_texture_table - 1;
+	int i;
+
+	if (gl_texture_table == NULL)
+		return NULL;
+
+	for (i = hash_fnv1a_string(s) & mask; gl_texture_table[i]; i = (i + 1) & mask)
+	{
+		if (strcmp(gl_textures[gl_texture_table[i] - 1].name, s) == 0)
+			return &gl_textures[gl_texture_table[i] - 1];
+	}
+
+	return NULL;
+}
+
+/*
+ * process_atlas
+ */
+
+void process_atlas(void)
 {
 	/* variables */
-	int i, v;
+	int i, n;
+	int *sources, *widths, *heights, *source_of;
+	int num_sources = 0;
+	int level, num_levels;
+	GLint max_size, max_layers;
+
+	/* every wad texture and the placeholder can be a source */
+	n = num_gl_textures + 1;
+	sources = malloc(n * sizeof(int));
+	widths = malloc(n * sizeof(int));
+	heights = malloc(n * sizeof(int));
+	source_of = malloc(n * sizeof(int));
+	if (!sources || !widths || !heights || !source_of)
+		error("failed malloc");
+
+	for (i = 0; i < n; i++)
+		source_of[i] = -1;
+
+	/* gather the textures the mesh uses, once each */
+	for (i = 0; i < gl_mesh->num_textures; i++)
+	{
+		gl_texture_t *texture = lookup_texture(gl_mesh->textures[i].name);
+		int src;
 
-	/* open list */
-	gl_bsp = glGenLists(1);
-	glNewList(gl_bsp, GL_COMPILE);
+		src = texture ? (int)(texture - gl_textures) : num_gl_textures;
 
-	glShadeModel(GL_FLAT);
+		if (source_of[src] < 0)
+		{
+			source_of[src] = num_sources;
+			sources[num_sources] = src;
+			widths[num_sources] = texture ? texture->width : 8;
+			heights[num_sources] = texture ? texture->height : 8;
+			num_sources++;
+		}
+
+		/* remember the source until the rects are known */
+		gl_mesh->textures[i].layer = source_of[src];
+	}
 
-	/* do commands */
-	for (i = 0; i < bsp->num_polygons; i++)
+	/* pack */
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+	gl_atlas = atlas_pack(widths, heights, num_sources, max_size);
+	if (gl_atlas && gl_atlas->num_layers > max_layers)
 	{
-		/* variables */
-		vec3_t tu, tv, to;
+		printf("warning: atlas needs %d layers, only %d available\n", gl_atlas->num_layers, max_layers);
+		atlas_free(gl_atlas);
+		gl_atlas = NULL;
+	}
+
+	if (gl_atlas)
+	{
+		/* levels go as deep as every rect stays on whole texels */
+		num_levels = 1;
+		while (use_mipmaps && (1 << num_levels) <= gl_atlas->width)
+		{
+			int mask = (1 << num_levels) - 1;
+
+			for (i = 0; i < num_sources; i++)
+			{
+				atlas_rect_t *rect = &gl_atlas->rects[i];
+				if ((rect->x | rect->y | rect->width | rect->height) & mask)
+					break;
+			}
+			if (i < num_sources)
+				break;
+
+			num_levels++;
+		}
+
+		/* upload */
+		glGenTextures(1, &gl_mesh->array);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, gl_mesh->array);
+		for (level = 0; level < num_levels; level++)
+		{
+			if (use_indexed)
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_R8, gl_atlas->width >> level, gl_atlas->height >> level, gl_atlas->num_layers, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+			else
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGB8, gl_atlas->width >> level, gl_atlas->height >> level, gl_atlas->num_layers, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+		}
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, num_levels - 1);
+		if (num_levels > 1)
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, use_indexed ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST_MIPMAP_LINEAR);
+		else
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-		/* find texture */
-		v = find_texture(bsp->polygons[i].tname);
+		for (i = 0; i < num_sources; i++)
+		{
+			atlas_rect_t *rect = &gl_atlas->rects[i];
+			gl_texture_t *source = sources[i] < num_gl_textures ? &gl_textures[sources[i]] : &placeholder;
 
-		glBindTexture(GL_TEXTURE_2D, v);
-		glEnable(GL_TEXTURE_2D);
-		glBegin(GL_TRIANGLE_FAN);
+			for (level = 0; level < num_levels; level++)
+			{
+				uint8_t *pixels = texture_level(source->pixels, source->width, source->height, use_indexed ? 1 : 3, level);
 
-		/* copy values */
-		tu = bsp->polygons[i].tu;
-		tv = bsp->polygons[i].tv;
-		to = bsp->polygons[i].to;
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, rect->x >> level, rect->y >> level, rect->layer,
+					rect->width >> level, rect->height >> level, 1, use_indexed ? GL_RED : GL_RGB, GL_UNSIGNED_BYTE, pixels);
+			}
+		}
 
-		for (v = 0; v < bsp->polygons[i].num_verts; v++)
+		/* place each mesh texture */
+		for (i = 0; i < gl_mesh->num_textures; i++)
 		{
-			float s, t;
-			vec3_t p, tp, nu, nv;
-
-			p.x = bsp->xcomponents[bsp->vertices[bsp->polygons[i].verts[v]].x];
-			p.y = bsp->ycomponents[bsp->vertices[bsp->polygons[i].verts[v]].y];
-			p.z = bsp->zcomponents[bsp->vertices[bsp->polygons[i].verts[v]].z];
-
-			/* calc offset */
-			tp.x = (p.x - to.x);
-			tp.y = (p.y - to.y);
-			tp.z = (p.z - to.z);
-
-			/* normalize */
-			nu = tu;
-			nv = tv;
-			normalize(&nu);
-			normalize(&nv);
-
-			/* get s,t */
-			s = dot(tp, nu) / 8;
-			t = dot(tp, nv) / 8;
-
-			/* yeah */
-			s *= SCALE;
-			t *= SCALE;
-			p.x *= SCALE;
-			p.y *= SCALE;
-			p.z *= SCALE;
-
-			/* do commands */
-			glTexCoord2f(s, t);
-			glVertex3f(p.x, p.y, p.z);
+			gl_texture_t *texture = &gl_mesh->textures[i];
+			atlas_rect_t *rect = &gl_atlas->rects[texture->layer];
+
+			texture->layer = rect->layer;
+			texture->rect[0] = (float)rect->x / gl_atlas->width;
+			texture->rect[1] = (float)rect->y / gl_atlas->height;
+			texture->rect[2] = (float)rect->width / gl_atlas->width;
+			texture->rect[3] = (float)rect->height / gl_atlas->height;
 		}
 
-		/* end gl */
-		glEnd();
-		glDisable(GL_TEXTURE_2D);
+		printf("packed %d textures into %d %dx%d layers\n", num_sources, gl_atlas->num_layers, gl_atlas->width, gl_atlas->height);
+	}
+	else
+	{
+		/* fall back to binding textures one by one */
+		for (i = 0; i < gl_mesh->num_textures; i++)
+			gl_mesh->textures[i].layer = 0;
+	}
+
+	free(sources);
+	free(widths);
+	free(heights);
+	free(source_of);
+}
+
+/*
+ * process_bsp
+ */
+
+void process_bsp(gl_mesh_t *mesh, vec3_t viewpoint)
+{
+	/* variables */
+	int i;
+
+	/* the loader already built it */
+	gl_mesh = mesh;
+
+	/* resolve each bsp texture once, the untextured range has no name */
+	/* textures still decoding get swapped in by drain_textures */
+	if (!gl_placeholder)
+		gl_placeholder = make_placeholder();
+	for (i = 0; i < gl_mesh->num_textures; i++)
+	{
+		gl_texture_t *texture = lookup_texture(gl_mesh->textures[i].name);
+		gl_mesh->textures[i].id = texture ? texture->id : gl_placeholder;
 	}
 
-	/* close list */
-	glEndList();
+	/* indexed textures resolve through the palette */
+	if (use_indexed)
+		gl_mesh->palette = gl_palette;
 
-	/* set camera pos */
-	camera_set_pos(
-		bsp->camera.viewpoint.x * SCALE,
-		bsp->camera.viewpoint.y * SCALE,
-		bsp->camera.viewpoint.z * SCALE
-	);
+	/* optionally pack them all into one texture array */
+	if (use_atlas)
+		process_atlas();
+
+	/* upload once */
+	if (!upload_mesh(gl_mesh))
+		error("couldn't upload mesh");
+
+	/* set camera pos, unless the first batch already did */
+	if (!camera_placed)
+	{
+		camera_set_pos(viewpoint.x * SCALE, viewpoint.y * SCALE, viewpoint.z * SCALE);
+		camera_placed = true;
+	}
 }
 
 /*
- * process_wad
+ * loader_fail
  */
 
-void process_wad(wad_t *wad)
+void loader_fail(const char *s, ...)
 {
-	int i, p;
+	va_list ap;
+
+	pthread_mutex_lock(&loader.mutex);
+	if (!loader.failure[0])
+	{
+		va_start(ap, s);
+		vsnprintf(loader.failure, sizeof(loader.failure), s, ap);
+		va_end(ap);
+	}
+
+	/* wake anyone blocked on the batch queue or the wads */
+	pthread_cond_broadcast(&loader.signal);
+	pthread_mutex_unlock(&loader.mutex);
+}
+
+/*
+ * loader_push
+ */
+
+void loader_push(loaded_t *loaded)
+{
+	pthread_mutex_lock(&loader.mutex);
+
+	/* nothing to upload, just stop waiting for it */
+	if (loaded == NULL)
+		loader.num_decoding--;
+	else if (loader.tail)
+		loader.tail = loader.tail->next = loaded;
+	else
+		loader.head = loader.tail = loaded;
+
+	pthread_cond_broadcast(&loader.signal);
+	pthread_mutex_unlock(&loader.mutex);
+}
+
+/*
+ * decode_texture
+ */
+
+void decode_texture(void *arg)
+{
+	decode_t *decode = (decode_t *)arg;
+	loaded_t *loaded;
+	gl_texture_t *texture;
 	mip_t *mip;
-	int num_pixels;
-	uint8_t *palette;
+	int level, w, h;
+	int bpp = use_indexed ? 1 : 3;
+	size_t len;
+
+	loaded = calloc(1, sizeof(loaded_t));
+	if (loaded == NULL)
+	{
+		free(decode);
+		loader_push(NULL);
+		return;
+	}
+
+	loaded->bsp_texture = decode->bsp_texture;
+	texture = &loaded->texture;
+	strncpy(texture->name, loader.bsp->textures[decode->bsp_texture].name, sizeof(texture->name) - 1);
+
+	/* get mip, a failed one or one short of its full size level */
+	/* arrives without pixels */
+	mip = mip_view(wad_lump_data(decode->wad, decode->lump), decode->lump->len_data);
+	free(decode);
+	if (mip && mip->entries[0].width * mip->entries[0].height != mip->header.width * mip->header.height)
+		mip = mip_free(mip);
+	if (mip == NULL)
+	{
+		loader_push(loaded);
+		return;
+	}
+
+	texture->width = mip->header.width;
+	texture->height = mip->header.height;
+	texture->num_levels = use_mipmaps ? count_levels(texture->width, texture->height) : 1;
+
+	/* room for every level */
+	len = 0;
+	for (level = 0, w = texture->width, h = texture->height; level < texture->num_levels; level++)
+	{
+		len += w * h * bpp;
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+	texture->pixels = malloc(len);
+
+	/* use the stored levels while they have the right size */
+	for (level = 0, w = texture->width, h = texture->height; texture->pixels && level < texture->num_levels; level++)
+	{
+		uint8_t *src, *dst;
+
+		if (level > 0 && (level >= mip->header.num_entries || mip->entries[level].width * mip->entries[level].height != w * h))
+		{
+			generate_level(texture, level);
+		}
+		else
+		{
+			src = mip->entries[level].pixels;
+			dst = texture_level(texture->pixels, texture->width, texture->height, bpp, level);
+
+			if (use_indexed)
+			{
+				/* keep the 8 bit indices as they are */
+				memcpy(dst, src, w * h);
+			}
+			else
+			{
+				/* create 24 bit version */
+				palette_expand(&loader.expanded, src, dst, w * h, 3);
+			}
+		}
+
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+
+	mip_free(mip);
+	loader_push(loaded);
+}
+
+/*
+ * loader_queue
+ */
+
+void loader_queue(void)
+{
+	int i, j;
+	int num_queued = 0, num_skipped = 0, num_overridden = 0;
+	size_t len_skipped = 0;
+	decode_t *decodes;
+	wad_lump_t *lump;
+	char name[9];
+
+	decodes = calloc(loader.bsp->num_textures + 1, sizeof(decode_t));
+	if (decodes == NULL)
+	{
+		loader_fail("failed malloc");
+		return;
+	}
+
+	/* only the textures the map uses, through the layered directory */
+	for (i = 0; i < loader.bsp->num_textures; i++)
+	{
+		/* these keep the placeholder */
+		lump = wad_index_find(loader.index, loader.bsp->textures[i].name, 11);
+		if (lump == NULL)
+		{
+			printf("warning: couldn't find texture %s\n", loader.bsp->textures[i].name);
+			continue;
+		}
+
+		/* the wad it came from */
+		for (j = 0; j < loader.num_wads; j++)
+		{
+			if (lump >= loader.wads[j]->lumps && lump < loader.wads[j]->lumps + loader.wads[j]->header.num_lumps)
+				break;
+		}
+
+		decodes[num_queued].bsp_texture = i;
+		decodes[num_queued].wad = loader.wads[j];
+		decodes[num_queued].lump = lump;
+		num_queued++;
+	}
+
+	/* tally what we didn't need */
+	for (j = 0; j < loader.num_wads; j++)
+	{
+		for (i = 0; i < loader.wads[j]->header.num_lumps; i++)
+		{
+			lump = &loader.wads[j]->lumps[i];
+
+			/* only miptex */
+			if (lump->type != 11)
+				continue;
+
+			memcpy(name, lump->name, 8);
+			name[8] = '\0';
+			if (wad_index_find(loader.index, name, 11) != lump)
+				num_overridden++;
+			else
+			{
+				num_skipped++;
+				len_skipped += lump->len_data;
+			}
+		}
+	}
+	for (i = 0; i < num_queued; i++)
+	{
+		num_skipped--;
+		len_skipped -= decodes[i].lump->len_data;
+	}
+
+	printf("%d textures from %d wads, %d overridden, %d unused skipped (%zu KB)\n",
+		num_queued, loader.num_wads, num_overridden, num_skipped, len_skipped / 1024);
+
+	/* count them all before any can arrive */
+	pthread_mutex_lock(&loader.mutex);
+	loader.num_decoding = num_queued;
+	pthread_mutex_unlock(&loader.mutex);
+
+	/* each job owns a copy of its decode */
+	for (i = 0; i < num_queued; i++)
+	{
+		decode_t *decode = malloc(sizeof(decode_t));
+
+		if (decode == NULL)
+		{
+			loader_push(NULL);
+			continue;
+		}
+
+		*decode = decodes[i];
+		pool_submit(loader.pool, decode_texture, decode);
+	}
+
+	free(decodes);
+}
+
+/*
+ * loader_finished
+ */
+
+void loader_finished(void)
+{
+	int num_jobs;
+
+	pthread_mutex_lock(&loader.mutex);
+	num_jobs = --loader.num_jobs;
+	pthread_mutex_unlock(&loader.mutex);
+
+	/* the last one in starts decoding, now the bsp names and wads are both known */
+	if (num_jobs > 0)
+		return;
+
+	if (!loader.failure[0])
+		loader_queue();
+
+	pthread_mutex_lock(&loader.mutex);
+	loader.ready = true;
+	pthread_cond_broadcast(&loader.signal);
+	pthread_mutex_unlock(&loader.mutex);
+}
+
+/*
+ * load_bsp
+ */
+
+void load_bsp(void *arg)
+{
+	(void)arg;
+
+	loader.bsp = bsp_read(loader.bsp_filename);
+	if (loader.bsp == NULL)
+		loader_fail("couldn't read bsp %s", loader.bsp_filename);
+	else if (!bsp_resolve_positions(loader.bsp, BSP_POSITIONS_INTERLEAVED))
+		loader_fail("couldn't resolve bsp positions");
+	else if ((loader.mesh = mesh_from_bsp(loader.bsp, SCALE)) == NULL)
+		loader_fail("couldn't build mesh");
+	else
+		loader.viewpoint = loader.bsp->camera.viewpoint;
+
+	loader_finished();
+}
+
+/*
+ * load_wads
+ */
+
+void load_wads(void *arg)
+{
+	int i;
+
+	(void)arg;
+
+	for (i = 0; i < loader.num_wads; i++)
+	{
+		loader.wads[i] = wad_open(loader.wad_filenames[i], WAD_MAP);
+		if (loader.wads[i] == NULL)
+		{
+			loader_fail("couldn't read wad %s", loader.wad_filenames[i]);
+			loader_finished();
+			return;
+		}
+	}
+
+	/* layer the wads, adding the last first so it wins without */
+	/* changing which duplicate wins inside a single wad */
+	loader.index = wad_index_create(0);
+	for (i = loader.num_wads - 1; loader.index && i >= 0; i--)
+	{
+		if (!wad_index_add_wad(loader.index, loader.wads[i], 0))
+			break;
+	}
+	if (loader.index == NULL || i >= 0)
+	{
+		loader_fail("failed malloc");
+		loader_finished();
+		return;
+	}
+
+	/* the last wad with a palette wins */
+	for (i = loader.num_wads - 1; i >= 0 && loader.palette == NULL; i--)
+		loader.palette = wad_find(loader.wads[i], "PAL", NULL);
+	if (loader.palette == NULL)
+		loader_fail("couldn't find palette");
+	else
+		palette_init(&loader.expanded, loader.palette, -1);
+
+	/* the renderer can start on the palette before the bsp is done */
+	pthread_mutex_lock(&loader.mutex);
+	loader.wads_ready = true;
+	pthread_cond_broadcast(&loader.signal);
+	pthread_mutex_unlock(&loader.mutex);
+
+	loader_finished();
+}
+
+/*
+ * bundle_flags
+ */
+
+uint32_t bundle_flags(void)
+{
+	return (use_indexed ? BUNDLE_INDEXED : 0) | (use_mipmaps ? BUNDLE_MIPMAPS : 0);
+}
 
-	palette = wad_find(wad, "PAL", NULL);
+/*
+ * load_bundle
+ */
+
+void load_bundle(void *arg)
+{
+	Uint64 start = SDL_GetPerformanceCounter();
+	bundle_header_t *header;
+	loaded_t *loaded;
+	int i;
+
+	(void)arg;
+
+	/* stamped first to catch writes from here on, the key is only */
+	/* worth hashing up front when there's a bundle it could open */
+	loader.stamp = bundle_stamp(loader.bsp_filename, loader.wad_filenames, loader.num_wads);
+	if (file_stat(loader.bundle_filename, NULL, NULL))
+		loader.keyed = bundle_key(loader.bsp_filename, loader.wad_filenames, loader.num_wads, bundle_flags(), SCALE, &loader.key);
+	if (loader.keyed)
+		loader.bundle = bundle_open(loader.bundle_filename, loader.key, bundle_flags());
+	if (loader.bundle)
+		loader.mesh = bundle_mesh(loader.bundle);
+
+	/* otherwise the bsp and the wads load side by side */
+	if (loader.mesh == NULL)
+	{
+		bundle_free(loader.bundle);
+		loader.bundle = NULL;
+
+		pthread_mutex_lock(&loader.mutex);
+		loader.num_jobs = 2;
+		pthread_mutex_unlock(&loader.mutex);
+
+		pool_submit(loader.pool, load_bsp, NULL);
+		pool_submit(loader.pool, load_wads, NULL);
+		return;
+	}
 
-	/* generate textures */
-	for (i = 0; i < wad->header.num_lumps; i++)
+	header = loader.bundle->header;
+	loader.palette = header->palette;
+	loader.viewpoint = header->viewpoint;
+
+	/* textures go up straight from the bundle */
+	pthread_mutex_lock(&loader.mutex);
+	for (i = 0; i < header->num_textures; i++)
 	{
-		/* only miptex */
-		if (wad->lumps[i].type != 11)
+		bundle_texture_t *texture = &loader.bundle->textures[i];
+
+		loaded = calloc(1, sizeof(loaded_t));
+		if (loaded == NULL)
 			continue;
 
-		/* get mip */
-		mip = mip_from_buffer(wad->lumps[i].data, wad->lumps[i].len_data);
-		if (!mip)
+		loaded->bsp_texture = texture->range;
+		strncpy(loaded->texture.name, loader.bundle->ranges[texture->range].name, sizeof(loaded->texture.name) - 1);
+		loaded->texture.width = texture->width;
+		loaded->texture.height = texture->height;
+		loaded->texture.num_levels = texture->num_levels;
+		loaded->texture.pixels = bundle_pixels(loader.bundle, i);
+
+		if (loader.tail)
+			loader.tail = loader.tail->next = loaded;
+		else
+			loader.head = loader.tail = loaded;
+		loader.num_decoding++;
+	}
+
+	loader.wads_ready = true;
+	loader.ready = true;
+	pthread_cond_broadcast(&loader.signal);
+	pthread_mutex_unlock(&loader.mutex);
+
+	printf("loaded %s, %d triangles and %d textures, in %.1f ms\n", loader.bundle_filename,
+		header->num_triangles, header->num_textures, (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+}
+
+/*
+ * save_bundle
+ */
+
+void save_bundle(void *arg)
+{
+	Uint64 start = SDL_GetPerformanceCounter();
+	uint32_t *key = arg;
+	gl_texture_t **textures;
+	int i;
+
+	/* a cold start left the key for now, off the load's critical path */
+	if (!loader.keyed)
+		loader.keyed = bundle_key(loader.bsp_filename, loader.wad_filenames, loader.num_wads, bundle_flags(), SCALE, key);
+
+	/* the key only describes what was loaded if nothing changed */
+	/* between the stamp at startup and the end of the hashing */
+	if (bundle_stamp(loader.bsp_filename, loader.wad_filenames, loader.num_wads) != loader.stamp)
+	{
+		printf("warning: sources changed while loading, not writing %s\n", loader.bundle_filename);
+		return;
+	}
+
+	textures = calloc(gl_mesh->num_textures, sizeof(gl_texture_t *));
+	if (!loader.keyed || textures == NULL)
+	{
+		free(textures);
+		return;
+	}
+
+	/* the renderer is done changing these, it only draws now */
+	for (i = 0; i < gl_mesh->num_textures; i++)
+		textures[i] = lookup_texture(gl_mesh->textures[i].name);
+
+	if (bundle_write(loader.bundle_filename, *key, bundle_flags(), gl_mesh, textures, loader.palette, loader.viewpoint))
+		printf("wrote %s in %.1f ms\n", loader.bundle_filename, (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+	else
+		printf("warning: couldn't write %s\n", loader.bundle_filename);
+
+	free(textures);
+}
+
+/*
+ * loader_save
+ */
+
+void loader_save(void)
+{
+	/* only after a full load from the sources */
+	if (loader.bundle || loader.failure[0] || gl_mesh == NULL)
+		return;
+
+	pool_submit(loader.pool, save_bundle, &loader.key);
+}
+
+/*
+ * mesh_batch
+ */
+
+void mesh_batch(void *arg)
+{
+	chunk_t *chunk = arg;
+	gl_mesh_t *mesh = NULL;
+	bool quit;
+
+	pthread_mutex_lock(&loader.mutex);
+	quit = loader.quit;
+	pthread_mutex_unlock(&loader.mutex);
+
+	/* the slot stays put until it's meshed, a failed one is skipped */
+	if (!quit)
+		mesh = mesh_from_bsp(chunk->batch, SCALE);
+
+	pthread_mutex_lock(&loader.mutex);
+	chunk->mesh = mesh;
+	chunk->meshed = true;
+	pthread_mutex_unlock(&loader.mutex);
+}
+
+/*
+ * queue_batch
+ */
+
+void queue_batch(bsp_t *batch, void *arg)
+{
+	chunk_t *chunk;
+
+	(void)arg;
+
+	/* parser thread, wait for room so memory stays bounded */
+	pthread_mutex_lock(&loader.mutex);
+	while (loader.num_batches == BATCH_QUEUE_LEN && !loader.quit && !loader.failure[0])
+		pthread_cond_wait(&loader.signal, &loader.mutex);
+
+	/* nobody is going to draw it */
+	if (loader.quit || loader.failure[0])
+	{
+		pthread_mutex_unlock(&loader.mutex);
+		bsp_free(batch);
+		return;
+	}
+
+	/* take the next slot now, so batches come out in parse order */
+	chunk = &loader.chunks[(loader.first_chunk + loader.num_batches++) % BATCH_QUEUE_LEN];
+	chunk->batch = batch;
+	chunk->mesh = NULL;
+	chunk->meshed = false;
+	pthread_mutex_unlock(&loader.mutex);
+
+	/* mesh it on a worker so the parser keeps going */
+	pool_submit(loader.pool, mesh_batch, chunk);
+}
+
+/*
+ * parse_aborted
+ */
+
+int parse_aborted(void *arg)
+{
+	bool quit;
+
+	(void)arg;
+
+	pthread_mutex_lock(&loader.mutex);
+	quit = loader.quit;
+	pthread_mutex_unlock(&loader.mutex);
+
+	return quit;
+}
+
+/*
+ * pop_chunk
+ */
+
+bool pop_chunk(chunk_t *chunk)
+{
+	bool popped = false;
+
+	/* oldest first, the rest wait while it is still meshing */
+	pthread_mutex_lock(&loader.mutex);
+	while (!popped && loader.num_batches && loader.chunks[loader.first_chunk].meshed)
+	{
+		*chunk = loader.chunks[loader.first_chunk];
+		loader.first_chunk = (loader.first_chunk + 1) % BATCH_QUEUE_LEN;
+		loader.num_batches--;
+		pthread_cond_broadcast(&loader.signal);
+
+		popped = chunk->mesh != NULL;
+		if (!popped)
+			bsp_free(chunk->batch);
+	}
+	pthread_mutex_unlock(&loader.mutex);
+
+	return popped;
+}
+
+/*
+ * loader_start
+ */
+
+void loader_start(const char *bsp_filename, const char **wad_filenames, int num_wads)
+{
+	int num_threads = pool_num_cpus();
+
+	loader.bsp_filename = bsp_filename;
+	loader.wad_filenames = wad_filenames;
+	loader.num_wads = num_wads;
+	loader.wads = calloc(num_wads, sizeof(wad_t *));
+	loader.bundle_filename = malloc(strlen(bsp_filename) + 8);
+	if (loader.wads == NULL || loader.bundle_filename == NULL)
+		error("failed malloc");
+	sprintf(loader.bundle_filename, "%s.bundle", bsp_filename);
+
+	pthread_mutex_init(&loader.mutex, NULL);
+	pthread_cond_init(&loader.signal, NULL);
+
+	/* the bundle, or else the bsp and the wads side by side */
+	loader.pool = pool_create(num_threads < 2 ? 2 : num_threads);
+	if (loader.pool == NULL)
+		error("couldn't start loader threads");
+
+	/* show the map in batches while it parses, until told to quit */
+	bsp_set_batch_func(queue_batch, NULL);
+	bsp_set_abort_func(parse_aborted, NULL);
+
+	pool_submit(loader.pool, load_bundle, NULL);
+}
+
+/*
+ * loader_wait
+ */
+
+void loader_wait(void)
+{
+	pthread_mutex_lock(&loader.mutex);
+	while (!loader.ready)
+		pthread_cond_wait(&loader.signal, &loader.mutex);
+	pthread_mutex_unlock(&loader.mutex);
+
+	if (loader.failure[0])
+		error("%s", loader.failure);
+}
+
+/*
+ * loader_wait_wads
+ */
+
+void loader_wait_wads(void)
+{
+	pthread_mutex_lock(&loader.mutex);
+	while (!loader.wads_ready && !loader.ready && !loader.failure[0])
+		pthread_cond_wait(&loader.signal, &loader.mutex);
+	pthread_mutex_unlock(&loader.mutex);
+
+	if (loader.failure[0])
+		error("%s", loader.failure);
+}
+
+/*
+ * loader_done
+ */
+
+bool loader_done(void)
+{
+	bool ready;
+
+	pthread_mutex_lock(&loader.mutex);
+	ready = loader.ready;
+	pthread_mutex_unlock(&loader.mutex);
+
+	return ready;
+}
+
+/*
+ * drain_batches
+ */
+
+void drain_batches(int max)
+{
+	chunk_t chunk;
+	int i, n;
+
+	for (n = 0; n < max && pop_chunk(&chunk); n++)
+	{
+		/* every batch carries the camera */
+		if (!camera_placed)
 		{
-			printf("couldn't read mip %s\n", wad->lumps[i].name);
+			camera_set_pos(
+				chunk.batch->camera.viewpoint.x * SCALE,
+				chunk.batch->camera.viewpoint.y * SCALE,
+				chunk.batch->camera.viewpoint.z * SCALE
+			);
+			camera_placed = true;
+		}
+		bsp_free(chunk.batch);
+
+		/* textures only arrive for the whole map, so these stay placeholders */
+		for (i = 0; i < chunk.mesh->num_textures; i++)
+			chunk.mesh->textures[i].id = gl_placeholder;
+		if (use_indexed)
+			chunk.mesh->palette = gl_palette;
+
+		if (num_gl_chunks >= max_gl_chunks)
+		{
+			max_gl_chunks = max_gl_chunks ? max_gl_chunks * 2 : 64;
+			gl_chunks = realloc(gl_chunks, max_gl_chunks * sizeof(gl_mesh_t *));
+			if (gl_chunks == NULL)
+				error("failed malloc");
+		}
+
+		if (!upload_mesh(chunk.mesh))
+		{
+			mesh_free(chunk.mesh);
 			continue;
 		}
 
-		/* copy values for searching */
-		memcpy(gl_textures[num_gl_textures].name, wad->lumps[i].name, 8);
-		gl_textures[num_gl_textures].width = mip->header.width;
-		gl_textures[num_gl_textures].height = mip->header.height;
-		num_pixels = gl_textures[num_gl_textures].width * gl_textures[num_gl_textures].height;
+		gl_chunks[num_gl_chunks++] = chunk.mesh;
+	}
+}
+
+/*
+ * free_chunks
+ */
+
+void free_chunks(void)
+{
+	chunk_t chunk;
+	int i;
+
+	/* and whatever didn't make it out of the queue */
+	while (pop_chunk(&chunk))
+	{
+		bsp_free(chunk.batch);
+		mesh_free(chunk.mesh);
+	}
+
+	for (i = 0; i < num_gl_chunks; i++)
+	{
+		unload_mesh(gl_chunks[i]);
+		mesh_free(gl_chunks[i]);
+	}
+
+	free(gl_chunks);
+	gl_chunks = NULL;
+	num_gl_chunks = max_gl_chunks = 0;
+}
 
-		/* create 24 bit version */
-		gl_textures[num_gl_textures].pixels = malloc(num_pixels * 3);
-		for (p = 0; p < num_pixels; p++)
+/*
+ * drain_textures
+ */
+
+bool drain_textures(int max)
+{
+	loaded_t *loaded;
+	gl_texture_t *texture;
+	bool pending;
+	int n = 0;
+
+	/* upload up to max decoded textures, or all of them when max is zero */
+	while (max == 0 || n < max)
+	{
+		pthread_mutex_lock(&loader.mutex);
+		while (max == 0 && loader.head == NULL && loader.num_decoding > 0)
+			pthread_cond_wait(&loader.signal, &loader.mutex);
+		loaded = loader.head;
+		if (loaded)
+		{
+			loader.head = loaded->next;
+			if (loader.head == NULL)
+				loader.tail = NULL;
+			loader.num_decoding--;
+		}
+		pthread_mutex_unlock(&loader.mutex);
+
+		if (loaded == NULL)
+			break;
+
+		if (loaded->texture.pixels == NULL)
+		{
+			printf("couldn't read mip %s\n", loaded->texture.name);
+		}
+		else
 		{
-			uint8_t *entry = &((uint8_t *)palette)[mip->entries[0].pixels[p] * 3];
-			gl_textures[num_gl_textures].pixels[p * 3] = *(entry);
-			gl_textures[num_gl_textures].pixels[(p * 3) + 1] = *(entry + 1);
-			gl_textures[num_gl_textures].pixels[(p * 3) + 2] = *(entry + 2);
+			texture = register_texture(loaded->texture.name);
+			texture->width = loaded->texture.width;
+			texture->height = loaded->texture.height;
+			texture->num_levels = loaded->texture.num_levels;
+			texture->pixels = loaded->texture.pixels;
+			upload_texture(texture);
+
+			/* swap the placeholder out */
+			if (gl_mesh)
+				gl_mesh->textures[loaded->bsp_texture].id = texture->id;
 		}
 
-		glGenTextures(1, &gl_textures[num_gl_textures].id);
-		glBindTexture(GL_TEXTURE_2D, gl_textures[num_gl_textures].id);
-		glTexImage2D(GL_TEXTURE_2D, 0, 3, gl_textures[num_gl_textures].width, gl_textures[num_gl_textures].height, 0, GL_RGB, GL_UNSIGNED_BYTE, gl_textures[num_gl_textures].pixels);
+		free(loaded);
+		n++;
+	}
+
+	pthread_mutex_lock(&loader.mutex);
+	pending = loader.num_decoding > 0;
+	pthread_mutex_unlock(&loader.mutex);
+
+	return pending;
+}
+
+/*
+ * loader_stop
+ */
+
+void loader_stop(void)
+{
+	/* a parser waiting on the batch queue gives up, then jobs finish */
+	pthread_mutex_lock(&loader.mutex);
+	loader.quit = true;
+	pthread_cond_broadcast(&loader.signal);
+	pthread_mutex_unlock(&loader.mutex);
+	pool_destroy(loader.pool);
+	loader.pool = NULL;
+	bsp_set_batch_func(NULL, NULL);
+	bsp_set_abort_func(NULL, NULL);
+}
+
+/*
+ * loader_free
+ */
+
+void loader_free(void)
+{
+	loaded_t *loaded;
+	chunk_t chunk;
+	int i;
+
+	loader_stop();
+
+	/* every batch is meshed or skipped once the jobs are done */
+	while (pop_chunk(&chunk))
+	{
+		bsp_free(chunk.batch);
+		mesh_free(chunk.mesh);
+	}
+	mesh_free(loader.mesh);
+
+	while ((loaded = loader.head) != NULL)
+	{
+		loader.head = loaded->next;
+		if (loader.bundle == NULL)
+			free(loaded->texture.pixels);
+		free(loaded);
+	}
+
+	pthread_mutex_destroy(&loader.mutex);
+	pthread_cond_destroy(&loader.signal);
+
+	bsp_free(loader.bsp);
+	bundle_free(loader.bundle);
+	free(loader.bundle_filename);
+	wad_index_free(loader.index);
+	for (i = 0; i < loader.num_wads; i++)
+		wad_free(loader.wads[i]);
+	free(loader.wads);
+}
+
+/*
+ * process_wads
+ */
+
+void process_wads(void)
+{
+	wad_palette = loader.palette;
+
+	/* rows are tightly packed */
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	/* indexed textures share one 256x1 palette texture */
+	if (use_indexed)
+	{
+		glGenTextures(1, &gl_palette);
+		glBindTexture(GL_TEXTURE_2D, gl_palette);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, 256, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, wad_palette);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	}
 
-		/* number of gl textures */
-		num_gl_textures++;
+	/* everything starts out on this */
+	if (!gl_placeholder)
+		gl_placeholder = make_placeholder();
+}
 
-		/* free miptex */
-		mip_free(mip);
-	}
+/*
+ * finish_bsp
+ */
+
+void finish_bsp(void)
+{
+	Uint64 start = SDL_GetPerformanceCounter();
+
+	/* raises any loading errors */
+	loader_wait();
+
+	/* the texture array is packed from every texture at once */
+	if (use_atlas)
+		drain_textures(0);
+
+	/* the whole map replaces the batches */
+	process_bsp(loader.mesh, loader.viewpoint);
+	loader.mesh = NULL;
+	if (num_gl_chunks)
+		fprintf(stderr, "replaced %d batches in %.1f ms\n", num_gl_chunks, (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+	free_chunks();
 }
 
 /*
@@ -255,45 +1495,91 @@ int main(int argc, char *argv[])
 	float time = 0.0f;
 	Uint64 time_current, time_last;
 	float deltatime;
-	bsp_t *bsp = NULL;
-	wad_t *wad = NULL;
+	const char **wad_filenames = NULL;
+	int num_wads = 0;
+	const char *bsp_filename = "DEMO4.BSP";
+	int renderer = RENDERER_LEGACY;
+	bool show_fps = false;
+	Uint64 fps_start = 0;
+	int fps_frames = 0;
+	Uint64 time_start = SDL_GetPerformanceCounter();
+	bool first_frame = true;
+	bool loading;
+
+	/* room for every --wad */
+	wad_filenames = calloc(argc + 1, sizeof(char *));
+	if (wad_filenames == NULL)
+		error("failed malloc");
 
 	/* check if user specified files */
 	for (i = 1; i < argc; i++)
 	{
 		/* bsp */
 		if (strcmp(argv[i], "--bsp") == 0 && i + 1 < argc)
-		{
-			bsp = bsp_read(argv[i + 1]);
-			if (!bsp) error("couldn't read bsp %s", argv[i + 1]);
-		}
+			bsp_filename = argv[i + 1];
 
-		/* wad */
+		/* wads, later ones override earlier ones */
 		if (strcmp(argv[i], "--wad") == 0 && i + 1 < argc)
-		{
-			wad = wad_read(argv[i + 1]);
-			if (!wad) error("couldn't read wad %s", argv[i + 1]);
-		}
+			wad_filenames[num_wads++] = argv[i + 1];
+
+		/* parser threads */
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			bsp_set_threads(atoi(argv[i + 1]));
+
+		/* renderer */
+		if (strcmp(argv[i], "--renderer") == 0 && i + 1 < argc)
+			renderer = strcmp(argv[i + 1], "core") == 0 ? RENDERER_CORE : RENDERER_LEGACY;
+
+		/* texture array */
+		if (strcmp(argv[i], "--atlas") == 0)
+			use_atlas = true;
+
+		/* single level textures */
+		if (strcmp(argv[i], "--nomip") == 0)
+			use_mipmaps = false;
+
+		/* 8 bit textures */
+		if (strcmp(argv[i], "--indexed") == 0)
+			use_indexed = true;
+
+		/* frame time report */
+		if (strcmp(argv[i], "--fps") == 0)
+			show_fps = true;
+	}
+
+	/* texture arrays need the core renderer */
+	if (use_atlas && renderer != RENDERER_CORE)
+	{
+		printf("warning: --atlas needs --renderer core\n");
+		use_atlas = false;
+	}
+	if (use_indexed && renderer != RENDERER_CORE)
+	{
+		printf("warning: --indexed needs --renderer core\n");
+		use_indexed = false;
 	}
 
-	/* read them again if user didn't select */
-	if (bsp == NULL) bsp = bsp_read("DEMO4.BSP");
-	if (bsp == NULL) error("couldn't read bsp DEMO4.BSP");
-	if (wad == NULL) wad = wad_read("MACT.WAD");
-	if (wad == NULL) error("couldn't read wad MACT.WAD");
+	/* read files in the background */
+	if (num_wads == 0)
+		wad_filenames[num_wads++] = "MACT.WAD";
+	loader_start(bsp_filename, wad_filenames, num_wads);
 
-	/* init sdl and gl  */
-	init(640, 480, "glPrey");
+	/* init sdl and gl meanwhile */
+	if (!init(640, 480, "glPrey", renderer))
+		error("couldn't create %s gl context", renderer == RENDERER_CORE ? "3.3 core" : "1.2");
+
+	/* vsync would hide the frame time */
+	if (show_fps)
+		SDL_GL_SetSwapInterval(0);
 
 	/* print gl info */
 	fprintf(stderr, "%s\n", glGetString(GL_VERSION));
 	fprintf(stderr, "%s\n", glGetString(GL_RENDERER));
 
-	/* init wad */
-	process_wad(wad);
-
-	/* init bsp */
-	process_bsp(bsp);
+	/* the map fills in as it parses, so only the palette is needed now */
+	loader_wait_wads();
+	process_wads();
+	loading = true;
 
 	/* start time */
 	time_last = SDL_GetTicks64();
@@ -324,29 +1610,91 @@ int main(int argc, char *argv[])
 		}
 
 		/* render map, optionally with wireframe */
-		glPushMatrix();
 		if (wireframe == true)
 			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 		else
 			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-		glCallList(gl_bsp);
-		glPopMatrix();
+		if (gl_mesh)
+		{
+			draw_mesh(gl_mesh);
+		}
+		else
+		{
+			for (i = 0; i < num_gl_chunks; i++)
+				draw_mesh(gl_chunks[i]);
+		}
+
+		/* report startup */
+		if (first_frame)
+		{
+			fprintf(stderr, "first frame after %.1f ms\n", (double)(SDL_GetPerformanceCounter() - time_start) * 1000.0 / SDL_GetPerformanceFrequency());
+			first_frame = false;
+		}
+
+		/* turn node batches into meshes until the whole map is in */
+		if (gl_mesh == NULL)
+		{
+			drain_batches(BATCHES_PER_FRAME);
+			if (loader_done())
+			{
+				finish_bsp();
+				fprintf(stderr, "map loaded after %.1f ms\n", (double)(SDL_GetPerformanceCounter() - time_start) * 1000.0 / SDL_GetPerformanceFrequency());
+			}
+		}
+
+		/* upload textures as they finish decoding */
+		else if (loading && !drain_textures(UPLOADS_PER_FRAME))
+		{
+			fprintf(stderr, "textures loaded after %.1f ms\n", (double)(SDL_GetPerformanceCounter() - time_start) * 1000.0 / SDL_GetPerformanceFrequency());
+			loading = false;
+
+			/* next time it all comes from one file */
+			loader_save();
+		}
+
+		/* report average frame time once a second */
+		if (show_fps)
+		{
+			Uint64 now = SDL_GetPerformanceCounter();
+			double elapsed;
+
+			if (!fps_start) fps_start = now;
+			fps_frames++;
+			elapsed = (double)(now - fps_start) / SDL_GetPerformanceFrequency();
+			if (elapsed >= 1.0)
+			{
+				fprintf(stderr, "%.3f ms/frame (%.1f fps)\n", elapsed * 1000.0 / fps_frames, fps_frames / elapsed);
+				fps_start = now;
+				fps_frames = 0;
+			}
+		}
 
 		/* update frame time */
 		time_last = time_current;
 	}
 
-	/* free textures */
+	/* a bundle may still be saving from the mesh and textures */
+	free_chunks();
+	loader_stop();
+
+	/* free textures, bundled ones live in its mapping */
 	for (i = 0; i < num_gl_textures; i++)
 	{
-		if (gl_textures[i].pixels)
+		if (gl_textures[i].pixels && loader.bundle == NULL)
 			free(gl_textures[i].pixels);
 	}
+	free(gl_textures);
+	free(gl_texture_table);
 
 	/* quit */
-	glDeleteLists(gl_bsp, 1);
-	bsp_free(bsp);
-	wad_free(wad);
+	if (gl_mesh)
+		unload_mesh(gl_mesh);
+	mesh_free(gl_mesh);
+	atlas_free(gl_atlas);
+	glDeleteTextures(1, &gl_placeholder);
+	if (gl_palette) glDeleteTextures(1, &gl_palette);
+	loader_free();
+	free(wad_filenames);
 	quit();
 
 	/* exit gracefully */
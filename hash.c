@@ -0,0 +1,88 @@
+/*
+MIT License
+
+Copyright (c) 2023 erysdren (it/she/they)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ *
+ * headers
+ *
+ */
+
+/* std */
+#include <stddef.h>
+#include <stdint.h>
+
+/* hash */
+#include "hash.h"
+
+/*
+ *
+ * macros
+ *
+ */
+
+/* fnv-1a 32 bit parameters */
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+/*
+ *
+ * functions
+ *
+ */
+
+/*
+ * hash_fnv1a
+ */
+
+uint32_t hash_fnv1a(const void *data, size_t len)
+{
+	const uint8_t *bytes = (const uint8_t *)data;
+	uint32_t hash = FNV_OFFSET;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+/*
+ * hash_fnv1a_string
+ */
+
+uint32_t hash_fnv1a_string(const char *s)
+{
+	uint32_t hash = FNV_OFFSET;
+
+	while (*s)
+	{
+		hash ^= (uint8_t)*s++;
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
@@ -0,0 +1,295 @@
+/*
+MIT License
+
+Copyright (c) 2023 erysdren (it/she/they)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ *
+ * headers
+ *
+ */
+
+/* std */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+/* mesh */
+#include "mesh.h"
+
+/*
+ *
+ * functions
+ *
+ */
+
+/*
+ * mesh_normalize
+ */
+
+static vec3_t mesh_normalize(vec3_t v)
+{
+	float w = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+	v.x /= w;
+	v.y /= w;
+	v.z /= w;
+	return v;
+}
+
+/*
+ * mesh_polygon_valid
+ */
+
+static int mesh_polygon_valid(bsp_t *bsp, polygon_t *polygon)
+{
+	int v;
+
+	/* needs at least one triangle */
+	if (polygon->num_verts < 3)
+		return 0;
+
+	for (v = 0; v < polygon->num_verts; v++)
+	{
+		if ((unsigned)bsp->indices[polygon->first_index + v] >= (unsigned)bsp->num_vertices)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * mesh_hash
+ */
+
+static uint32_t mesh_hash(int index, int texture, float s, float t)
+{
+	uint32_t a, b, h;
+
+	memcpy(&a, &s, 4);
+	memcpy(&b, &t, 4);
+
+	h = (uint32_t)index * 0x9E3779B1u;
+	h ^= (uint32_t)texture * 0x85EBCA77u;
+	h ^= a * 0xC2B2AE3Du;
+	h ^= b * 0x27D4EB2Fu;
+	h ^= h >> 15;
+	h *= 0x2C1B3C6Du;
+	h ^= h >> 13;
+
+	return h;
+}
+
+/*
+ * mesh_from_bsp
+ */
+
+gl_mesh_t *mesh_from_bsp(bsp_t *bsp, float scale)
+{
+	/* variables */
+	gl_mesh_t *mesh;
+	int *keys, *table;
+	int len_table;
+	int num_corners = 0;
+	int num_triangles = 0;
+	int i, v, b;
+
+	/* positions get read straight from the resolved array */
+	if (bsp->positions == NULL)
+	{
+		if (!bsp_resolve_positions(bsp, (bsp->positions_x ? BSP_POSITIONS_SOA : 0) | BSP_POSITIONS_INTERLEAVED))
+			return NULL;
+	}
+
+	/* alloc */
+	mesh = calloc(1, sizeof(gl_mesh_t));
+	if (mesh == NULL)
+	{
+		printf("error: failed malloc\n");
+		return NULL;
+	}
+
+	/* one range per bsp texture, plus one for untextured polygons */
+	mesh->num_textures = bsp->num_textures + 1;
+	mesh->textures = calloc(mesh->num_textures, sizeof(gl_texture_t));
+	if (mesh->textures == NULL)
+	{
+		printf("error: failed malloc\n");
+		mesh_free(mesh);
+		return NULL;
+	}
+
+	for (i = 0; i < bsp->num_textures; i++)
+		memcpy(mesh->textures[i].name, bsp->textures[i].name, sizeof(mesh->textures[i].name) - 1);
+
+	/* count triangles per texture */
+	for (i = 0; i < bsp->num_polygons; i++)
+	{
+		polygon_t *polygon = &bsp->polygons[i];
+
+		if (!mesh_polygon_valid(bsp, polygon))
+			continue;
+
+		b = (unsigned)polygon->texture < (unsigned)bsp->num_textures ? polygon->texture : bsp->num_textures;
+		mesh->textures[b].num_triangles += polygon->num_verts - 2;
+		num_corners += polygon->num_verts;
+	}
+
+	/* texture ranges */
+	for (i = 0; i < mesh->num_textures; i++)
+	{
+		mesh->textures[i].first_triangle = num_triangles;
+		num_triangles += mesh->textures[i].num_triangles;
+		mesh->textures[i].num_triangles = 0;
+	}
+
+	/* weld table at most half full */
+	len_table = 16;
+	while (len_table < num_corners * 2)
+		len_table *= 2;
+
+	/* alloc buffers, vertices are trimmed once welded */
+	mesh->vertices = malloc((num_corners + 1) * sizeof(vec3_t));
+	mesh->texcoords = malloc((num_corners + 1) * sizeof(vec2_t));
+	mesh->triangles = malloc((num_triangles + 1) * sizeof(vec3i_t));
+	keys = malloc((num_corners + 1) * 2 * sizeof(int));
+	table = calloc(len_table, sizeof(int));
+	if (!mesh->vertices || !mesh->texcoords || !mesh->triangles || !keys || !table)
+	{
+		printf("error: failed malloc\n");
+		free(keys);
+		free(table);
+		mesh_free(mesh);
+		return NULL;
+	}
+
+	/* fan out every polygon */
+	for (i = 0; i < bsp->num_polygons; i++)
+	{
+		polygon_t *polygon = &bsp->polygons[i];
+		vec3_t nu, nv;
+		int first = 0, prev = 0;
+
+		if (!mesh_polygon_valid(bsp, polygon))
+			continue;
+
+		b = (unsigned)polygon->texture < (unsigned)bsp->num_textures ? polygon->texture : bsp->num_textures;
+
+		/* texture axes */
+		nu = mesh_normalize(polygon->tu);
+		nv = mesh_normalize(polygon->tv);
+
+		for (v = 0; v < polygon->num_verts; v++)
+		{
+			int index = bsp->indices[polygon->first_index + v];
+			vec3_t pos = bsp->positions[index];
+			vec3_t tp;
+			float s, t;
+			uint32_t slot;
+			int id;
+
+			/* calc offset */
+			tp.x = pos.x - polygon->to.x;
+			tp.y = pos.y - polygon->to.y;
+			tp.z = pos.z - polygon->to.z;
+
+			/* get s,t */
+			s = (tp.x * nu.x + tp.y * nu.y + tp.z * nu.z) / 8;
+			t = (tp.x * nv.x + tp.y * nv.y + tp.z * nv.z) / 8;
+			s *= scale;
+			t *= scale;
+
+			/* weld corners sharing a vertex and texcoords within a texture */
+			slot = mesh_hash(index, b, s, t) & (len_table - 1);
+			while ((id = table[slot] - 1) >= 0)
+			{
+				if (keys[id * 2] == index && keys[id * 2 + 1] == b &&
+					mesh->texcoords[id].x == s && mesh->texcoords[id].y == t)
+					break;
+				slot = (slot + 1) & (len_table - 1);
+			}
+
+			/* new vertex */
+			if (id < 0)
+			{
+				id = mesh->num_vertices++;
+				table[slot] = id + 1;
+				keys[id * 2] = index;
+				keys[id * 2 + 1] = b;
+				mesh->vertices[id].x = pos.x * scale;
+				mesh->vertices[id].y = pos.y * scale;
+				mesh->vertices[id].z = pos.z * scale;
+				mesh->texcoords[id].x = s;
+				mesh->texcoords[id].y = t;
+			}
+
+			/* fan */
+			if (v == 0)
+			{
+				first = id;
+			}
+			else if (v >= 2)
+			{
+				vec3i_t *triangle = &mesh->triangles[mesh->textures[b].first_triangle + mesh->textures[b].num_triangles++];
+				triangle->x = first;
+				triangle->y = prev;
+				triangle->z = id;
+			}
+
+			prev = id;
+		}
+	}
+
+	free(keys);
+	free(table);
+
+	mesh->num_texcoords = mesh->num_vertices;
+	mesh->num_triangles = num_triangles;
+
+	/* give back the slack */
+	if (mesh->num_vertices < num_corners)
+	{
+		void *vertices = realloc(mesh->vertices, (mesh->num_vertices + 1) * sizeof(vec3_t));
+		void *texcoords = realloc(mesh->texcoords, (mesh->num_vertices + 1) * sizeof(vec2_t));
+		if (vertices) mesh->vertices = vertices;
+		if (texcoords) mesh->texcoords = texcoords;
+	}
+
+	return mesh;
+}
+
+/*
+ * mesh_free
+ */
+
+void mesh_free(gl_mesh_t *mesh)
+{
+	if (mesh)
+	{
+		if (mesh->vertices) free(mesh->vertices);
+		if (mesh->texcoords) free(mesh->texcoords);
+		if (mesh->triangles && !mesh->interleaved) free(mesh->triangles);
+		if (mesh->textures) free(mesh->textures);
+		free(mesh);
+	}
+}
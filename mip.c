@@ -33,7 +33,11 @@ SOFTWARE.
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
-#include <math.h>
+
+/* simd */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /* wad */
 #include "mip.h"
@@ -45,27 +49,41 @@ SOFTWARE.
  */
 
 /*
- * mip_from_buffer
+ * mip_parse
  */
 
-mip_t *mip_from_buffer(void *buffer, size_t buffer_len)
+static mip_t *mip_parse(void *buffer, size_t buffer_len, int view)
 {
 	/* variables */
 	int i;
 	mip_t *mip;
 	uint8_t *ptr;
 	uint16_t offsets[64];
-	uint16_t sizes[64];
+	size_t sizes[64];
+	int width, height;
+
+	/* header and offsets have to fit */
+	if (buffer_len < sizeof(mip_header_t))
+		return NULL;
 
 	/* alloc */
-	mip = malloc(sizeof(mip_t));
+	mip = calloc(1, sizeof(mip_t));
 	if (mip == NULL) return NULL;
+	mip->view = view;
 
 	/* read header */
 	ptr = (uint8_t *)buffer;
 	memcpy(&mip->header, ptr, sizeof(mip_header_t));
 	ptr += sizeof(mip_header_t);
 
+	if (mip->header.num_entries == 0 || mip->header.num_entries > 64 ||
+		mip->header.width == 0 || mip->header.height == 0 ||
+		buffer_len < sizeof(mip_header_t) + mip->header.num_entries * sizeof(uint16_t))
+	{
+		free(mip);
+		return NULL;
+	}
+
 	/* get offsets */
 	for (i = 0; i < mip->header.num_entries; i++)
 	{
@@ -73,29 +91,61 @@ mip_t *mip_from_buffer(void *buffer, size_t buffer_len)
 		ptr += sizeof(uint16_t);
 	}
 
-	/* get sizes */
+	/* level sizes come from the header, halving down to 1 */
 	for (i = 0; i < mip->header.num_entries; i++)
 	{
-		if (i == mip->header.num_entries - 1)
-			sizes[i] = buffer_len - offsets[i];
-		else
-			sizes[i] = offsets[i + 1] - offsets[i];
+		if (offsets[i] > buffer_len || (i < mip->header.num_entries - 1 && offsets[i + 1] < offsets[i]))
+		{
+			free(mip);
+			return NULL;
+		}
+
+		width = mip->header.width >> i;
+		height = mip->header.height >> i;
+		sizes[i] = (size_t)(width > 1 ? width : 1) * (height > 1 ? height : 1);
+
+		/* the full size level has to be there, smaller ones */
+		/* that run off the end are left out */
+		if (offsets[i] + sizes[i] > buffer_len)
+		{
+			if (i == 0)
+			{
+				free(mip);
+				return NULL;
+			}
+
+			mip->header.num_entries = i;
+			break;
+		}
 	}
 
 	/* allocate entries */
-	mip->entries = malloc(sizeof(mip_entry_t) * mip->header.num_entries);
+	mip->entries = calloc(mip->header.num_entries, sizeof(mip_entry_t));
+	if (mip->entries == NULL)
+		return mip_free(mip);
 
 	/* get pixels */
 	for (i = 0; i < mip->header.num_entries; i++)
 	{
 		/* width / height */
-		mip->entries[i].width = mip->entries[i].height = (uint8_t)sqrtf(sizes[i]);
+		width = mip->header.width >> i;
+		height = mip->header.height >> i;
+		mip->entries[i].width = width > 1 ? width : 1;
+		mip->entries[i].height = height > 1 ? height : 1;
 
-		/* pixels */
-		mip->entries[i].pixels = malloc(sizes[i]);
-
-		/* copy */
 		ptr = (uint8_t *)buffer + offsets[i];
+
+		/* views share the buffer */
+		if (view)
+		{
+			mip->entries[i].pixels = ptr;
+			continue;
+		}
+
+		/* copies own their pixels */
+		mip->entries[i].pixels = malloc(sizes[i]);
+		if (mip->entries[i].pixels == NULL)
+			return mip_free(mip);
 		memcpy(mip->entries[i].pixels, ptr, sizes[i]);
 	}
 
@@ -103,6 +153,24 @@ mip_t *mip_from_buffer(void *buffer, size_t buffer_len)
 	return mip;
 }
 
+/*
+ * mip_from_buffer
+ */
+
+mip_t *mip_from_buffer(void *buffer, size_t buffer_len)
+{
+	return mip_parse(buffer, buffer_len, 0);
+}
+
+/*
+ * mip_view
+ */
+
+mip_t *mip_view(void *buffer, size_t buffer_len)
+{
+	return mip_parse(buffer, buffer_len, 1);
+}
+
 /*
  * mip_from_buffer
  */
@@ -139,7 +207,7 @@ void *mip_free(mip_t *mip)
 	{
 		if (mip->entries)
 		{
-			for (i = 0; i < mip->header.num_entries; i++)
+			for (i = 0; i < mip->header.num_entries && !mip->view; i++)
 			{
 				if (mip->entries[i].pixels)
 					free(mip->entries[i].pixels);
@@ -153,3 +221,78 @@ void *mip_free(mip_t *mip)
 
 	return NULL;
 }
+
+/*
+ * mip_downsample
+ */
+
+void mip_downsample(const uint8_t *src, int width, int height, int channels, uint8_t *dst)
+{
+	/* variables */
+	int dst_width = width > 1 ? width / 2 : 1;
+	int dst_height = height > 1 ? height / 2 : 1;
+	int len = width * channels;
+	uint16_t *sums;
+	int x, y, c, i;
+
+	sums = malloc(len * sizeof(uint16_t) + 16);
+	if (sums == NULL)
+		return;
+
+	for (y = 0; y < dst_height; y++)
+	{
+		const uint8_t *row0 = src + (y * 2) * len;
+		const uint8_t *row1 = height > 1 ? row0 + len : row0;
+
+		/* add the row pair, sixteen bytes at a time where we can */
+		i = 0;
+#if defined(__SSE2__)
+		for (; i + 16 <= len; i += 16)
+		{
+			__m128i zero = _mm_setzero_si128();
+			__m128i a = _mm_loadu_si128((const __m128i *)(row0 + i));
+			__m128i b = _mm_loadu_si128((const __m128i *)(row1 + i));
+			_mm_storeu_si128((__m128i *)(sums + i), _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+			_mm_storeu_si128((__m128i *)(sums + i + 8), _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+		}
+#endif
+		for (; i < len; i++)
+			sums[i] = row0[i] + row1[i];
+
+		/* then the column pairs, rounding to nearest */
+		for (x = 0; x < dst_width; x++)
+		{
+			const uint16_t *a = sums + (x * 2) * channels;
+			const uint16_t *b = width > 1 ? a + channels : a;
+
+			for (c = 0; c < channels; c++)
+				*dst++ = (uint8_t)((a[c] + b[c] + 2) >> 2);
+		}
+	}
+
+	free(sums);
+}
+
+/*
+ * mip_decimate
+ */
+
+void mip_decimate(const uint8_t *src, int width, int height, int channels, uint8_t *dst)
+{
+	/* variables */
+	int dst_width = width > 1 ? width / 2 : 1;
+	int dst_height = height > 1 ? height / 2 : 1;
+	int x, y, c;
+
+	/* palette indices can't be blended, so keep every other texel */
+	for (y = 0; y < dst_height; y++)
+	{
+		const uint8_t *row = src + (y * 2) * width * channels;
+
+		for (x = 0; x < dst_width; x++)
+		{
+			for (c = 0; c < channels; c++)
+				*dst++ = row[(x * 2) * channels + c];
+		}
+	}
+}
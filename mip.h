@@ -44,9 +44,13 @@ typedef struct
 {
 	mip_header_t header;
 	mip_entry_t *entries;
+	int view; /* entries point into the source buffer */
 } mip_t;
 
 /* function prototypes */
 mip_t *mip_from_buffer(void *buffer, size_t buffer_len);
+mip_t *mip_view(void *buffer, size_t buffer_len);
 mip_t *mip_from_file(const char *filename);
 void *mip_free(mip_t *mip);
+void mip_downsample(const uint8_t *src, int width, int height, int channels, uint8_t *dst);
+void mip_decimate(const uint8_t *src, int width, int height, int channels, uint8_t *dst);
@@ -0,0 +1,310 @@
+/*
+MIT License
+
+Copyright (c) 2023 erysdren (it/she/they)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ *
+ * headers
+ *
+ */
+
+/* std */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+/* number */
+#include "number.h"
+
+/*
+ *
+ * macros
+ *
+ */
+
+/* eight digits at a time only works on little endian */
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_M_X64) || defined(_M_IX86)
+#define NUMBER_SWAR 1
+#else
+#define NUMBER_SWAR 0
+#endif
+
+/* most significant digits that fit in the mantissa accumulator */
+#define MAX_DIGITS 19
+
+/*
+ *
+ * globals
+ *
+ */
+
+/* exactly representable powers of ten */
+static const double powers[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+ *
+ * functions
+ *
+ */
+
+#if NUMBER_SWAR
+
+/*
+ * eight_digits
+ */
+
+static int eight_digits(uint64_t v)
+{
+	return (v & 0xF0F0F0F0F0F0F0F0ULL) == 0x3030303030303030ULL &&
+		((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) == 0x3030303030303030ULL;
+}
+
+/*
+ * parse_eight
+ */
+
+static uint32_t parse_eight(uint64_t v)
+{
+	/* pairs, then quads, then all eight, within one register */
+	v -= 0x3030303030303030ULL;
+	v = (v * 10) + (v >> 8);
+	v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+		(((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+	return (uint32_t)v;
+}
+
+#endif
+
+/*
+ * parse_digits
+ */
+
+static const char *parse_digits(const char *p, const char *end, uint64_t *mantissa, int *num_digits)
+{
+	uint64_t m = *mantissa;
+	int n = *num_digits;
+
+#if NUMBER_SWAR
+	/* eight digits per step while they can't overflow */
+	while (end - p >= 8 && n <= MAX_DIGITS - 8)
+	{
+		uint64_t v;
+		memcpy(&v, p, 8);
+		if (!eight_digits(v))
+			break;
+		m = m * 100000000 + parse_eight(v);
+		if (m) n += 8;
+		p += 8;
+	}
+#endif
+
+	/* the rest one at a time */
+	for (; p < end && *p >= '0' && *p <= '9'; p++)
+	{
+		if (n < MAX_DIGITS)
+		{
+			m = m * 10 + (uint64_t)(*p - '0');
+			if (m) n++;
+		}
+		else
+		{
+			/* dropped a digit, the fast path can't be exact */
+			n = MAX_DIGITS + 1;
+		}
+	}
+
+	*mantissa = m;
+	*num_digits = n;
+	return p;
+}
+
+/*
+ * number_fallback
+ */
+
+static double number_fallback(const char *str, int len)
+{
+	char buffer[64];
+
+	if (len > (int)sizeof(buffer) - 1)
+		len = sizeof(buffer) - 1;
+	if (len < 0)
+		len = 0;
+
+	memcpy(buffer, str, len);
+	buffer[len] = '\0';
+
+	return strtod(buffer, NULL);
+}
+
+/*
+ * number_double
+ */
+
+double number_double(const char *str, int len)
+{
+	/* variables */
+	const char *p = str;
+	const char *end = str + len;
+	const char *frac;
+	uint64_t m = 0;
+	int n = 0;
+	int exponent = 0;
+	int negative = 0;
+	double d;
+
+	/* sign */
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	/* integer part */
+	frac = p;
+	p = parse_digits(p, end, &m, &n);
+	if (p == frac && (p >= end || *p != '.'))
+		return number_fallback(str, len);
+
+	/* fractional part */
+	if (p < end && *p == '.')
+	{
+		frac = ++p;
+		p = parse_digits(p, end, &m, &n);
+		exponent -= (int)(p - frac);
+	}
+
+	/* exponents, hex, inf, nan and trailing junk go to libc */
+	if (p != end || n > MAX_DIGITS || m > (1ULL << 53) || exponent < -22)
+		return number_fallback(str, len);
+
+	/* both operands are exact, so one correctly rounded op gives */
+	/* the same double strtod would */
+	d = (double)m;
+	if (exponent < 0)
+		d /= powers[-exponent];
+
+	return negative ? -d : d;
+}
+
+/*
+ * number_int
+ */
+
+int number_int(const char *str, int len)
+{
+	/* variables */
+	const char *p = str;
+	const char *end = str + len;
+	uint64_t m = 0;
+	int n = 0;
+	int negative = 0;
+
+	/* sign */
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	/* digits, stopping at the first non-digit like atoi */
+	parse_digits(p, end, &m, &n);
+
+	return negative ? (int)(0 - (uint32_t)m) : (int)(uint32_t)m;
+}
+
+/*
+ * format_digits
+ */
+
+static int format_digits(char *str, uint64_t value, int min_digits)
+{
+	char digits[24];
+	int n = 0, i;
+
+	do
+	{
+		digits[n++] = (char)('0' + value % 10);
+		value /= 10;
+	}
+	while (value || n < min_digits);
+
+	for (i = 0; i < n; i++)
+		str[i] = digits[n - 1 - i];
+
+	return n;
+}
+
+/*
+ * number_format_int
+ */
+
+int number_format_int(char *str, int value)
+{
+	int n = 0;
+
+	if (value < 0)
+		str[n++] = '-';
+
+	n += format_digits(str + n, value < 0 ? 0 - (uint64_t)(int64_t)value : (uint64_t)value, 1);
+	str[n] = '\0';
+
+	return n;
+}
+
+/*
+ * number_format_float
+ */
+
+int number_format_float(char *str, float value)
+{
+	/* variables */
+	double x;
+	uint64_t r;
+	double frac;
+	int n = 0;
+
+	/* huge values, inf and nan go to libc */
+	x = value < 0 ? -(double)value : (double)value;
+	if (!(x < 1e12))
+		return snprintf(str, NUMBER_FORMAT_LEN, "%0.6f", value);
+
+	/* a float times 10^6 is exact in a double, so this rounds the */
+	/* same way printf does, ties to even */
+	x *= 1e6;
+	r = (uint64_t)x;
+	frac = x - (double)r;
+	if (frac > 0.5 || (frac == 0.5 && (r & 1)))
+		r++;
+
+	/* sign, including negative zero */
+	if (signbit(value))
+		str[n++] = '-';
+
+	/* integer and fractional parts */
+	n += format_digits(str + n, r / 1000000, 1);
+	str[n++] = '.';
+	n += format_digits(str + n, r % 1000000, 6);
+	str[n] = '\0';
+
+	return n;
+}
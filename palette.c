@@ -0,0 +1,229 @@
+/*
+MIT License
+
+Copyright (c) 2023 erysdren (it/she/they)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ *
+ * headers
+ *
+ */
+
+/* std */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* threads */
+#include <pthread.h>
+
+/* simd, picked at runtime */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PALETTE_X86 1
+#include <immintrin.h>
+#else
+#define PALETTE_X86 0
+#endif
+
+/* palette */
+#include "palette.h"
+
+/*
+ *
+ * types
+ *
+ */
+
+/* expansion kernel */
+typedef size_t (*palette_func_t)(const uint32_t *table, const uint8_t *src, uint8_t *dst, size_t num_pixels);
+
+/*
+ *
+ * globals
+ *
+ */
+
+static palette_func_t kernel_rgb = NULL;
+static palette_func_t kernel_rgba = NULL;
+static const char *kernel_name = "scalar";
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+/*
+ *
+ * functions
+ *
+ */
+
+/*
+ * palette_init
+ */
+
+void palette_init(palette_t *palette, const uint8_t *colors, int key)
+{
+	int i;
+
+	/* bytes in memory order, r g b a */
+	for (i = 0; i < 256; i++)
+	{
+		uint8_t texel[4];
+
+		texel[0] = colors[i * 3];
+		texel[1] = colors[(i * 3) + 1];
+		texel[2] = colors[(i * 3) + 2];
+		texel[3] = i == key ? 0 : 255;
+
+		memcpy(&palette->rgba[i], texel, 4);
+	}
+}
+
+#if PALETTE_X86
+
+/*
+ * expand_rgb_ssse3
+ */
+
+__attribute__((target("ssse3")))
+static size_t expand_rgb_ssse3(const uint32_t *table, const uint8_t *src, uint8_t *dst, size_t num_pixels)
+{
+	const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	size_t i = 0;
+
+	/* four texels per store, the last four bytes get overwritten */
+	for (; i + 6 <= num_pixels; i += 4)
+	{
+		__m128i v = _mm_setr_epi32(table[src[i]], table[src[i + 1]], table[src[i + 2]], table[src[i + 3]]);
+		_mm_storeu_si128((__m128i *)(dst + i * 3), _mm_shuffle_epi8(v, pack));
+	}
+
+	return i;
+}
+
+/*
+ * expand_rgb_avx2
+ */
+
+__attribute__((target("avx2")))
+static size_t expand_rgb_avx2(const uint32_t *table, const uint8_t *src, uint8_t *dst, size_t num_pixels)
+{
+	const __m256i pack = _mm256_setr_epi8(
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	size_t i = 0;
+
+	/* eight texels per gather, stored as two overlapping 16 byte halves */
+	for (; i + 12 <= num_pixels; i += 8)
+	{
+		__m128i indices = _mm_loadl_epi64((const __m128i *)(src + i));
+		__m256i v = _mm256_i32gather_epi32((const int *)table, _mm256_cvtepu8_epi32(indices), 4);
+		v = _mm256_shuffle_epi8(v, pack);
+		_mm_storeu_si128((__m128i *)(dst + i * 3), _mm256_castsi256_si128(v));
+		_mm_storeu_si128((__m128i *)(dst + i * 3 + 12), _mm256_extracti128_si256(v, 1));
+	}
+
+	return i;
+}
+
+/*
+ * expand_rgba_avx2
+ */
+
+__attribute__((target("avx2")))
+static size_t expand_rgba_avx2(const uint32_t *table, const uint8_t *src, uint8_t *dst, size_t num_pixels)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= num_pixels; i += 8)
+	{
+		__m128i indices = _mm_loadl_epi64((const __m128i *)(src + i));
+		__m256i v = _mm256_i32gather_epi32((const int *)table, _mm256_cvtepu8_epi32(indices), 4);
+		_mm256_storeu_si256((__m256i *)(dst + i * 4), v);
+	}
+
+	return i;
+}
+
+#endif
+
+/*
+ * palette_select
+ */
+
+static void palette_select(void)
+{
+#if PALETTE_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+	{
+		kernel_rgb = expand_rgb_avx2;
+		kernel_rgba = expand_rgba_avx2;
+		kernel_name = "avx2";
+	}
+	else if (__builtin_cpu_supports("ssse3"))
+	{
+		kernel_rgb = expand_rgb_ssse3;
+		kernel_name = "ssse3";
+	}
+#endif
+}
+
+/*
+ * palette_kernel
+ */
+
+const char *palette_kernel(void)
+{
+	pthread_once(&kernel_once, palette_select);
+
+	return kernel_name;
+}
+
+/*
+ * palette_expand
+ */
+
+void palette_expand(const palette_t *palette, const uint8_t *src, uint8_t *dst, size_t num_pixels, int channels)
+{
+	size_t i = 0;
+
+	palette_kernel();
+
+	if (channels == 4)
+	{
+		/* rgba */
+		if (kernel_rgba)
+			i = kernel_rgba(palette->rgba, src, dst, num_pixels);
+
+		for (; i < num_pixels; i++)
+			memcpy(dst + i * 4, &palette->rgba[src[i]], 4);
+	}
+	else
+	{
+		/* rgb */
+		if (kernel_rgb)
+			i = kernel_rgb(palette->rgba, src, dst, num_pixels);
+
+		for (; i < num_pixels; i++)
+			memcpy(dst + i * 3, &palette->rgba[src[i]], 3);
+	}
+}
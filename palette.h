@@ -0,0 +1,43 @@
+/*
+MIT License
+
+Copyright (c) 2023 erysdren (it/she/they)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef _PALETTE_H_
+#define _PALETTE_H_
+
+/* std */
+#include <stddef.h>
+#include <stdint.h>
+
+/* palette expanded to rgba, ready for lookups */
+typedef struct
+{
+	uint32_t rgba[256];
+} palette_t;
+
+/* function prototypes */
+void palette_init(palette_t *palette, const uint8_t *colors, int key);
+void palette_expand(const palette_t *palette, const uint8_t *src, uint8_t *dst, size_t num_pixels, int channels);
+const char *palette_kernel(void);
+
+#endif /* _PALETTE_H_ */
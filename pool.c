@@ -0,0 +1,258 @@
+/*
+MIT License
+
+Copyright (c) 2023 erysdren (it/she/they)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ *
+ * headers
+ *
+ */
+
+/* posix */
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+/* std */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* threads */
+#include <pthread.h>
+#ifndef _WIN32
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
+
+/* pool */
+#include "pool.h"
+
+/*
+ *
+ * types
+ *
+ */
+
+/* queued job */
+typedef struct pool_job_s
+{
+	pool_func_t func;
+	void *arg;
+	struct pool_job_s *next;
+} pool_job_t;
+
+/* worker pool */
+struct pool_s
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t work;
+	pthread_cond_t idle;
+	pool_job_t *head;
+	pool_job_t *tail;
+	int num_pending;
+	int quit;
+	pthread_t *threads;
+	int num_threads;
+};
+
+/*
+ *
+ * functions
+ *
+ */
+
+/*
+ * pool_worker
+ */
+
+static void *pool_worker(void *arg)
+{
+	pool_t *pool = (pool_t *)arg;
+	pool_job_t *job;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	while (1)
+	{
+		/* wait for work */
+		while (pool->head == NULL && !pool->quit)
+			pthread_cond_wait(&pool->work, &pool->mutex);
+
+		if (pool->head == NULL)
+			break;
+
+		/* pop job */
+		job = pool->head;
+		pool->head = job->next;
+		if (pool->head == NULL)
+			pool->tail = NULL;
+
+		/* run it unlocked */
+		pthread_mutex_unlock(&pool->mutex);
+		job->func(job->arg);
+		free(job);
+		pthread_mutex_lock(&pool->mutex);
+
+		/* wake waiters once everything is done */
+		if (--pool->num_pending == 0)
+			pthread_cond_broadcast(&pool->idle);
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+/*
+ * pool_create
+ */
+
+pool_t *pool_create(int num_threads)
+{
+	pool_t *pool;
+	int i;
+
+	if (num_threads < 1)
+		num_threads = pool_num_cpus();
+
+	/* alloc */
+	pool = calloc(1, sizeof(pool_t));
+	if (pool == NULL)
+		return NULL;
+
+	pool->threads = calloc(num_threads, sizeof(pthread_t));
+	if (pool->threads == NULL)
+	{
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->idle, NULL);
+
+	/* start workers */
+	for (i = 0; i < num_threads; i++)
+	{
+		if (pthread_create(&pool->threads[i], NULL, pool_worker, pool) != 0)
+			break;
+		pool->num_threads++;
+	}
+
+	if (pool->num_threads == 0)
+	{
+		pool_destroy(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+/*
+ * pool_submit
+ */
+
+void pool_submit(pool_t *pool, pool_func_t func, void *arg)
+{
+	pool_job_t *job;
+
+	/* run it here if we can't queue it */
+	job = malloc(sizeof(pool_job_t));
+	if (job == NULL)
+	{
+		func(arg);
+		return;
+	}
+
+	job->func = func;
+	job->arg = arg;
+	job->next = NULL;
+
+	/* push job */
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->tail)
+		pool->tail->next = job;
+	else
+		pool->head = job;
+	pool->tail = job;
+	pool->num_pending++;
+	pthread_cond_signal(&pool->work);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/*
+ * pool_wait
+ */
+
+void pool_wait(pool_t *pool)
+{
+	pthread_mutex_lock(&pool->mutex);
+	while (pool->num_pending)
+		pthread_cond_wait(&pool->idle, &pool->mutex);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/*
+ * pool_destroy
+ */
+
+void pool_destroy(pool_t *pool)
+{
+	int i;
+
+	if (pool)
+	{
+		/* finish queued work, then stop */
+		pthread_mutex_lock(&pool->mutex);
+		pool->quit = 1;
+		pthread_cond_broadcast(&pool->work);
+		pthread_mutex_unlock(&pool->mutex);
+
+		for (i = 0; i < pool->num_threads; i++)
+			pthread_join(pool->threads[i], NULL);
+
+		pthread_mutex_destroy(&pool->mutex);
+		pthread_cond_destroy(&pool->work);
+		pthread_cond_destroy(&pool->idle);
+		free(pool->threads);
+		free(pool);
+	}
+}
+
+/*
+ * pool_num_cpus
+ */
+
+int pool_num_cpus(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+#endif
+}
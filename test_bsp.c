@@ -0,0 +1,351 @@
+/*
+MIT License
+
+Copyright (c) 2023 erysdren (it/she/they)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ *
+ * headers
+ *
+ */
+
+/* std */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* glprey */
+#include "bsp.h"
+
+/*
+ *
+ * macros
+ *
+ */
+
+/* shared by both maps */
+#define STRUCTURE \
+	"STRUCTURE\n" \
+	"xcomponents 2\n0.000000\n64.000000\n" \
+	"ycomponents 2\n0.000000\n64.000000\n" \
+	"zcomponents 2\n0.000000\n64.000000\n" \
+	"numverts 4\n0 0 0\n1 0 0\n1 0 1\n0 0 1\n"
+
+#define POLYGON(p, verts, tname) \
+	"polygon " #p "\n" \
+	"verts " verts "\n" \
+	"tname " tname "\n" \
+	"tu 1.000000 0.000000 0.000000\n" \
+	"tv 0.000000 0.000000 1.000000\n" \
+	"to 0.000000 0.000000 0.000000\n"
+
+/*
+ *
+ * globals
+ *
+ */
+
+/* two linked nodes, polygon 0 is counted by numpolys but never */
+/* defined and polygon 4 belongs to no node */
+static const char *map_tree =
+	"CAMERA\n"
+	"viewpoint 1.000000 2.000000 3.000000\n"
+	"viewnormal 0.000000 0.000000 1.000000\n"
+	"viewangle 90\n"
+	"texturelength 64\n"
+	STRUCTURE
+	"numpolys 5\n"
+	"BSPTREE\n"
+	"numnodes 2\n"
+	"node 0\n"
+	"A 0.000000 B 1.000000 C 0.000000 D -32.000000\n"
+	"inid 0\n"
+	"outid 1\n"
+	"front 1\n"
+	"back -1\n"
+	POLYGON(1, "0 1 2 3", "TEX000")
+	POLYGON(2, "3 2 1 0", "A_LONGER_TEXTURE_NAME")
+	"node 1\n"
+	"A 1.000000 B 0.000000 C 0.000000 D 16.000000\n"
+	"inid 1\n"
+	"outid 2\n"
+	"front -1\n"
+	"back -1\n"
+	POLYGON(3, "0 1 2", "TEX000")
+	"node -1\n"
+	POLYGON(4, "1 2 3", "TEX001");
+
+/* no tree at all, just a polygon without a node */
+static const char *map_nodeless =
+	STRUCTURE
+	"numpolys 1\n"
+	"BSPTREE\n"
+	"numnodes 0\n"
+	"node -1\n"
+	POLYGON(0, "0 1 2 3", "TEX000");
+
+static int failures = 0;
+
+/*
+ *
+ * functions
+ *
+ */
+
+/*
+ * check
+ */
+
+static void check(int ok, const char *what)
+{
+	printf("%s: %s\n", ok ? "ok" : "FAIL", what);
+	if (!ok)
+		failures++;
+}
+
+/*
+ * same_nodes
+ */
+
+static int same_nodes(bsp_t *a, bsp_t *b)
+{
+	int i;
+
+	if (a->num_nodes != b->num_nodes)
+		return 0;
+
+	for (i = 0; i < a->num_nodes; i++)
+	{
+		node_t *na = &a->nodes[i], *nb = &b->nodes[i];
+
+		if (na->a != nb->a || na->b != nb->b || na->c != nb->c || na->d != nb->d ||
+			na->inid != nb->inid || na->outid != nb->outid ||
+			na->front != nb->front || na->back != nb->back)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * same_polygons
+ */
+
+static int same_polygons(bsp_t *a, bsp_t *b)
+{
+	int i, j;
+
+	if (a->num_polygons != b->num_polygons)
+		return 0;
+
+	for (i = 0; i < a->num_polygons; i++)
+	{
+		polygon_t *pa = &a->polygons[i], *pb = &b->polygons[i];
+
+		/* undefined ones have no node to compare */
+		if (pa->num_verts != pb->num_verts || pa->texture != pb->texture || (pa->num_verts && pa->node != pb->node))
+			return 0;
+		for (j = 0; j < pa->num_verts; j++)
+		{
+			if (a->indices[pa->first_index + j] != b->indices[pb->first_index + j])
+				return 0;
+		}
+		if (pa->texture >= 0 && strcmp(a->textures[pa->texture].name, b->textures[pb->texture].name) != 0)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * same_bsp
+ */
+
+static int same_bsp(bsp_t *a, bsp_t *b)
+{
+	return a->num_textures == b->num_textures &&
+		a->num_vertices == b->num_vertices &&
+		memcmp(a->vertices, b->vertices, a->num_vertices * sizeof(vec3i_t)) == 0 &&
+		memcmp(&a->camera, &b->camera, sizeof(camera_t)) == 0 &&
+		same_nodes(a, b) &&
+		same_polygons(a, b);
+}
+
+/*
+ * reparse
+ */
+
+static bsp_t *reparse(bsp_t *bsp, const char *filename)
+{
+	file_t *file;
+	bsp_t *saved;
+
+	/* straight from the buffer, so no cache gets written */
+	bsp_save(bsp, filename);
+	file = file_map(filename);
+	if (file == NULL)
+		return NULL;
+	saved = bsp_from_buffer(file->data, file->len);
+	file_unmap(file);
+	remove(filename);
+
+	return saved;
+}
+
+/*
+ * test_tree
+ */
+
+static void test_tree(const char *filename)
+{
+	bsp_t *bsp, *saved;
+
+	bsp = bsp_from_buffer(map_tree, strlen(map_tree));
+	check(bsp != NULL, "tree: parse");
+	if (bsp == NULL)
+		return;
+	check(bsp->num_polygons == 5 && bsp->polygons[0].num_verts == 0 && bsp->polygons[0].texture < 0, "tree: polygon 0 undefined");
+	check(bsp->num_textures == 3, "tree: three textures");
+	check(bsp->polygons[1].node == 0 && bsp->polygons[3].node == 1 && bsp->polygons[4].node == -1, "tree: polygon nodes");
+	check(bsp->nodes[0].front == 1 && bsp->nodes[0].back == -1 && bsp->nodes[1].inid == 1, "tree: node links");
+
+	/* text */
+	saved = reparse(bsp, filename);
+	check(saved != NULL, "tree: text round trip parses");
+	if (saved)
+	{
+		check(saved->num_textures == bsp->num_textures, "tree: text round trip keeps textures");
+		check(saved->polygons[0].num_verts == 0 && saved->polygons[0].texture < 0, "tree: text round trip keeps polygon 0 undefined");
+		check(saved->polygons[4].node == -1, "tree: text round trip keeps polygon 4 nodeless");
+		check(same_bsp(bsp, saved), "tree: text round trip matches");
+	}
+	bsp_free(saved);
+
+	/* binary, read through bsp_read */
+	bsp_save_binary(bsp, filename);
+	saved = bsp_read(filename);
+	check(saved != NULL, "tree: binary round trip reads");
+	if (saved)
+		check(same_bsp(bsp, saved), "tree: binary round trip matches");
+	bsp_free(saved);
+	remove(filename);
+
+	bsp_free(bsp);
+}
+
+/*
+ * test_nodeless
+ */
+
+static void test_nodeless(const char *filename)
+{
+	bsp_t *bsp, *saved;
+
+	bsp = bsp_from_buffer(map_nodeless, strlen(map_nodeless));
+	check(bsp != NULL && bsp->num_nodes == 0 && bsp->polygons[0].num_verts == 4, "nodeless: parse");
+	if (bsp == NULL)
+		return;
+
+	saved = reparse(bsp, filename);
+	check(saved != NULL && saved->polygons[0].num_verts == 4 && saved->polygons[0].node == -1, "nodeless: text round trip keeps the polygon");
+	if (saved)
+		check(same_bsp(bsp, saved), "nodeless: text round trip matches");
+	bsp_free(saved);
+
+	bsp_free(bsp);
+}
+
+/*
+ * test_corrupt
+ */
+
+static void test_corrupt(const char *filename)
+{
+	bsp_t *bsp, *cached;
+	file_t *file;
+	uint8_t *block, *buffer;
+	bsp_header_t *header;
+	polygon_t *polygon;
+	bsp_texture_t *texture;
+
+	bsp = bsp_from_buffer(map_tree, strlen(map_tree));
+	if (bsp == NULL)
+		return;
+	bsp_save_binary(bsp, filename);
+	bsp_free(bsp);
+
+	/* a writable copy, aligned the way a mapping would be */
+	file = file_map(filename);
+	remove(filename);
+	check(file != NULL, "corrupt: saved");
+	if (file == NULL)
+		return;
+	block = malloc(file->len + BSP_CACHE_ALIGN);
+	if (block == NULL)
+	{
+		file_unmap(file);
+		return;
+	}
+	buffer = block + (BSP_CACHE_ALIGN - (uintptr_t)block % BSP_CACHE_ALIGN) % BSP_CACHE_ALIGN;
+	memcpy(buffer, file->data, file->len);
+	header = (bsp_header_t *)buffer;
+	polygon = (polygon_t *)(buffer + header->lumps[BSP_LUMP_POLYGONS].ofs) + 1;
+	texture = (bsp_texture_t *)(buffer + header->lumps[BSP_LUMP_TEXTURES].ofs);
+
+	/* texture past the end */
+	polygon->texture = header->lumps[BSP_LUMP_TEXTURES].num;
+	cached = bsp_from_buffer(buffer, file->len);
+	check(cached == NULL, "corrupt: polygon texture out of range rejected");
+	bsp_free(cached);
+
+	/* no texture on a defined polygon */
+	polygon->texture = -1;
+	cached = bsp_from_buffer(buffer, file->len);
+	check(cached == NULL, "corrupt: defined polygon without texture rejected");
+	bsp_free(cached);
+	polygon->texture = 0;
+
+	/* unterminated name */
+	memset(texture->name, 'A', sizeof(texture->name));
+	cached = bsp_from_buffer(buffer, file->len);
+	check(cached == NULL, "corrupt: unterminated texture name rejected");
+	bsp_free(cached);
+
+	free(block);
+	file_unmap(file);
+}
+
+/*
+ * main
+ */
+
+int main(int argc, char *argv[])
+{
+	const char *filename = argc > 1 ? argv[1] : "test_bsp.tmp";
+
+	test_tree(filename);
+	test_nodeless(filename);
+	test_corrupt(filename);
+
+	return failures != 0;
+}
@@ -37,6 +37,34 @@ SOFTWARE.
 /* wad */
 #include "wad.h"
 
+/* hash */
+#include "hash.h"
+
+/*
+ *
+ * types
+ *
+ */
+
+/* index slot */
+struct wad_slot_s
+{
+	uint32_t hash;
+	wad_lump_t *lump;
+};
+
+/* lazy loading state */
+struct wad_lazy_s
+{
+	FILE *stream;
+	size_t budget; /* zero for no limit */
+	size_t resident;
+	int head; /* most recently used */
+	int tail; /* least recently used */
+	int *prev;
+	int *next;
+};
+
 /*
  *
  * functions
@@ -44,10 +72,203 @@ SOFTWARE.
  */
 
 /*
- * wad_read
+ * wad_key
  */
 
-wad_t *wad_read(const char *filename)
+static int wad_key(const char *search, char *key)
+{
+	int i;
+
+	/* pad out to 8 bytes like the names on disk */
+	for (i = 0; i < 8 && search[i]; i++)
+		key[i] = search[i];
+
+	/* too long to ever match */
+	if (i == 8 && search[i])
+		return 0;
+
+	for (; i < 8; i++)
+		key[i] = '\0';
+
+	return 1;
+}
+
+/*
+ * wad_pad_name
+ */
+
+static void wad_pad_name(char *name)
+{
+	int c;
+
+	/* zero anything after the terminator, so names compare as 8 bytes */
+	for (c = 0; c < 8 && name[c]; c++);
+	memset(name + c, 0, 8 - c);
+}
+
+/*
+ * wad_index_create
+ */
+
+wad_index_t *wad_index_create(int num_lumps)
+{
+	wad_index_t *index;
+	int num_slots = 16;
+
+	/* keep the load factor at or under half */
+	while (num_slots < num_lumps * 2)
+		num_slots *= 2;
+
+	index = calloc(1, sizeof(wad_index_t));
+	if (index == NULL)
+		return NULL;
+
+	index->slots = calloc(num_slots, sizeof(struct wad_slot_s));
+	if (index->slots == NULL)
+	{
+		free(index);
+		return NULL;
+	}
+
+	index->num_slots = num_slots;
+
+	return index;
+}
+
+/*
+ * wad_index_grow
+ */
+
+static int wad_index_grow(wad_index_t *index)
+{
+	struct wad_slot_s *slots;
+	int num_slots = index->num_slots * 2;
+	int mask = num_slots - 1;
+	int i, s;
+
+	slots = calloc(num_slots, sizeof(struct wad_slot_s));
+	if (slots == NULL)
+		return 0;
+
+	/* rehash */
+	for (i = 0; i < index->num_slots; i++)
+	{
+		if (index->slots[i].lump == NULL)
+			continue;
+
+		for (s = index->slots[i].hash & mask; slots[s].lump; s = (s + 1) & mask);
+		slots[s] = index->slots[i];
+	}
+
+	free(index->slots);
+	index->slots = slots;
+	index->num_slots = num_slots;
+
+	return 1;
+}
+
+/*
+ * wad_index_add
+ */
+
+int wad_index_add(wad_index_t *index, wad_lump_t *lump, int replace)
+{
+	uint32_t hash;
+	int mask, s;
+
+	if ((index->num_lumps + 1) * 2 > index->num_slots)
+	{
+		if (!wad_index_grow(index))
+			return 0;
+	}
+
+	hash = hash_fnv1a(lump->name, 8);
+	mask = index->num_slots - 1;
+
+	/* same name and type is the same lump, from this wad or an earlier one */
+	for (s = hash & mask; index->slots[s].lump; s = (s + 1) & mask)
+	{
+		wad_lump_t *other = index->slots[s].lump;
+
+		if (index->slots[s].hash == hash && other->type == lump->type &&
+			memcmp(other->name, lump->name, 8) == 0)
+		{
+			if (replace)
+				index->slots[s].lump = lump;
+			return 1;
+		}
+	}
+
+	index->slots[s].hash = hash;
+	index->slots[s].lump = lump;
+	index->num_lumps++;
+
+	return 1;
+}
+
+/*
+ * wad_index_add_wad
+ */
+
+int wad_index_add_wad(wad_index_t *index, wad_t *wad, int replace)
+{
+	int i;
+
+	for (i = 0; i < wad->header.num_lumps; i++)
+	{
+		if (!wad_index_add(index, &wad->lumps[i], replace))
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * wad_index_find
+ */
+
+wad_lump_t *wad_index_find(const wad_index_t *index, const char *name, int type)
+{
+	char key[8];
+	uint32_t hash;
+	int mask, s;
+
+	if (!wad_key(name, key))
+		return NULL;
+
+	hash = hash_fnv1a(key, 8);
+	mask = index->num_slots - 1;
+
+	for (s = hash & mask; index->slots[s].lump; s = (s + 1) & mask)
+	{
+		wad_lump_t *lump = index->slots[s].lump;
+
+		if (index->slots[s].hash == hash && memcmp(lump->name, key, 8) == 0 &&
+			(type == WAD_ANY_TYPE || lump->type == type))
+			return lump;
+	}
+
+	return NULL;
+}
+
+/*
+ * wad_index_free
+ */
+
+void wad_index_free(wad_index_t *index)
+{
+	if (index)
+	{
+		free(index->slots);
+		free(index);
+	}
+}
+
+/*
+ * wad_load
+ */
+
+static wad_t *wad_load(const char *filename, int lazy)
 {
 	/* variables */
 	FILE *file;
@@ -96,6 +317,41 @@ wad_t *wad_read(const char *filename)
 		fread(&wad->lumps[i].len_data, sizeof(int32_t), 1, file);
 		fread(&wad->lumps[i].type, sizeof(int32_t), 1, file);
 		fread(&wad->lumps[i].name, sizeof(char), 8, file);
+		wad_pad_name(wad->lumps[i].name);
+	}
+
+	/* index directory */
+	wad->index = wad_index_create(wad->header.num_lumps);
+	if (wad->index == NULL || !wad_index_add_wad(wad->index, wad, 0))
+	{
+		printf("error: failed malloc\n");
+		return NULL;
+	}
+
+	/* keep the file open and read lumps as they're asked for */
+	if (lazy)
+	{
+		wad->lazy = calloc(1, sizeof(struct wad_lazy_s));
+		if (wad->lazy == NULL)
+		{
+			printf("error: failed malloc\n");
+			fclose(file);
+			wad_free(wad);
+			return NULL;
+		}
+
+		wad->lazy->stream = file;
+		wad->lazy->head = wad->lazy->tail = -1;
+		wad->lazy->prev = malloc((wad->header.num_lumps + 1) * sizeof(int));
+		wad->lazy->next = malloc((wad->header.num_lumps + 1) * sizeof(int));
+		if (wad->lazy->prev == NULL || wad->lazy->next == NULL)
+		{
+			printf("error: failed malloc\n");
+			wad_free(wad);
+			return NULL;
+		}
+
+		return wad;
 	}
 
 	/* read lump data */
@@ -121,6 +377,245 @@ wad_t *wad_read(const char *filename)
 	return wad;
 }
 
+/*
+ * wad_read
+ */
+
+wad_t *wad_read(const char *filename)
+{
+	return wad_load(filename, 0);
+}
+
+/*
+ * wad_lru_unlink
+ */
+
+static void wad_lru_unlink(struct wad_lazy_s *lazy, int i)
+{
+	if (lazy->prev[i] >= 0)
+		lazy->next[lazy->prev[i]] = lazy->next[i];
+	else
+		lazy->head = lazy->next[i];
+
+	if (lazy->next[i] >= 0)
+		lazy->prev[lazy->next[i]] = lazy->prev[i];
+	else
+		lazy->tail = lazy->prev[i];
+}
+
+/*
+ * wad_lru_push
+ */
+
+static void wad_lru_push(struct wad_lazy_s *lazy, int i)
+{
+	lazy->prev[i] = -1;
+	lazy->next[i] = lazy->head;
+
+	if (lazy->head >= 0)
+		lazy->prev[lazy->head] = i;
+	else
+		lazy->tail = i;
+
+	lazy->head = i;
+}
+
+/*
+ * wad_evict
+ */
+
+static void wad_evict(wad_t *wad, size_t budget)
+{
+	struct wad_lazy_s *lazy = wad->lazy;
+
+	/* drop the coldest lumps until we fit */
+	while (lazy->tail >= 0 && lazy->resident > budget)
+	{
+		wad_lump_t *lump = &wad->lumps[lazy->tail];
+
+		wad_lru_unlink(lazy, lazy->tail);
+		lazy->resident -= lump->len_data;
+		free(lump->data);
+		lump->data = NULL;
+	}
+}
+
+/*
+ * wad_lump_data
+ */
+
+void *wad_lump_data(wad_t *wad, wad_lump_t *lump)
+{
+	struct wad_lazy_s *lazy = wad->lazy;
+	int i = (int)(lump - wad->lumps);
+	void *data;
+
+	if (lazy == NULL)
+		return lump->data;
+
+	/* already resident, just warm it */
+	if (lump->data)
+	{
+		wad_lru_unlink(lazy, i);
+		wad_lru_push(lazy, i);
+		return lump->data;
+	}
+
+	if (lump->len_data < 0)
+		return NULL;
+
+	/* make room first, so this one is never evicted */
+	if (lazy->budget)
+		wad_evict(wad, lazy->budget > (size_t)lump->len_data ? lazy->budget - lump->len_data : 0);
+
+	/* read */
+	data = malloc(lump->len_data ? lump->len_data : 1);
+	if (data == NULL)
+	{
+		printf("error: failed malloc\n");
+		return NULL;
+	}
+
+	if (fseek(lazy->stream, lump->ofs_data, SEEK_SET) != 0 ||
+		(lump->len_data && fread(data, lump->len_data, 1, lazy->stream) != 1))
+	{
+		printf("error: failed to read lump %.8s\n", lump->name);
+		free(data);
+		return NULL;
+	}
+
+	lump->data = data;
+	lazy->resident += lump->len_data;
+	wad_lru_push(lazy, i);
+
+	return data;
+}
+
+/*
+ * wad_set_budget
+ */
+
+void wad_set_budget(wad_t *wad, size_t budget)
+{
+	if (wad->lazy)
+	{
+		wad->lazy->budget = budget;
+		if (budget)
+			wad_evict(wad, budget);
+	}
+}
+
+/*
+ * wad_map
+ */
+
+static wad_t *wad_map(const char *filename)
+{
+	/* variables */
+	file_t *file;
+	wad_t *wad;
+	uint8_t *entry;
+	int i;
+
+	/* map file */
+	file = file_map(filename);
+	if (file == NULL)
+	{
+		printf("error: failed to open %s\n", filename);
+		return NULL;
+	}
+
+	/* alloc */
+	wad = calloc(1, sizeof(wad_t));
+	if (wad == NULL)
+	{
+		printf("error: failed malloc\n");
+		file_unmap(file);
+		return NULL;
+	}
+	wad->file = file;
+
+	/* check header */
+	if (file->len < sizeof(wad_header_t))
+	{
+		printf("error: invalid wad file\n");
+		wad_free(wad);
+		return NULL;
+	}
+	memcpy(&wad->header, file->data, sizeof(wad_header_t));
+	if (memcmp(&wad->header.magic, "IWAD", 4) != 0)
+	{
+		printf("error: invalid wad file\n");
+		wad_free(wad);
+		return NULL;
+	}
+
+	/* directory entries are 20 bytes on disk */
+	if (wad->header.num_lumps < 0 || wad->header.ofs_lumps < 0 ||
+		(size_t)wad->header.ofs_lumps + (size_t)wad->header.num_lumps * 20 > file->len)
+	{
+		printf("error: wad directory out of bounds\n");
+		wad_free(wad);
+		return NULL;
+	}
+
+	/* allocate lumps */
+	wad->lumps = calloc(wad->header.num_lumps ? wad->header.num_lumps : 1, sizeof(wad_lump_t));
+	if (wad->lumps == NULL)
+	{
+		printf("error: failed malloc\n");
+		wad_free(wad);
+		return NULL;
+	}
+
+	/* read lumps, pointing their data into the mapping */
+	entry = (uint8_t *)file->data + wad->header.ofs_lumps;
+	for (i = 0; i < wad->header.num_lumps; i++, entry += 20)
+	{
+		wad_lump_t *lump = &wad->lumps[i];
+
+		memcpy(&lump->ofs_data, entry, sizeof(int32_t));
+		memcpy(&lump->len_data, entry + 4, sizeof(int32_t));
+		memcpy(&lump->type, entry + 8, sizeof(int32_t));
+		memcpy(lump->name, entry + 12, 8);
+		wad_pad_name(lump->name);
+
+		if (lump->ofs_data < 0 || lump->len_data < 0 ||
+			(size_t)lump->ofs_data + (size_t)lump->len_data > file->len)
+		{
+			printf("error: lump %.8s out of bounds\n", lump->name);
+			wad_free(wad);
+			return NULL;
+		}
+
+		lump->data = (uint8_t *)file->data + lump->ofs_data;
+	}
+
+	/* index directory */
+	wad->index = wad_index_create(wad->header.num_lumps);
+	if (wad->index == NULL || !wad_index_add_wad(wad->index, wad, 0))
+	{
+		printf("error: failed malloc\n");
+		wad_free(wad);
+		return NULL;
+	}
+
+	/* return ptr */
+	return wad;
+}
+
+/*
+ * wad_open
+ */
+
+wad_t *wad_open(const char *filename, int flags)
+{
+	if (flags & WAD_MAP)
+		return wad_map(filename);
+
+	return wad_load(filename, flags & WAD_LAZY);
+}
+
 /*
  * wad_free
  */
@@ -133,7 +628,8 @@ void wad_free(wad_t *wad)
 	{
 		if (wad->lumps)
 		{
-			for (i = 0; i < wad->header.num_lumps; i++)
+			/* mapped lumps are owned by the mapping */
+			for (i = 0; i < wad->header.num_lumps && !wad->file; i++)
 			{
 				if (wad->lumps[i].data)
 					free(wad->lumps[i].data);
@@ -142,30 +638,38 @@ void wad_free(wad_t *wad)
 			free(wad->lumps);
 		}
 
+		if (wad->lazy)
+		{
+			if (wad->lazy->stream)
+				fclose(wad->lazy->stream);
+			free(wad->lazy->prev);
+			free(wad->lazy->next);
+			free(wad->lazy);
+		}
+
+		wad_index_free(wad->index);
+		file_unmap(wad->file);
 		free(wad);
 	}
 }
 
+/*
+ * wad_find_lump
+ */
+
+wad_lump_t *wad_find_lump(wad_t *wad, const char *name, int type)
+{
+	return wad_index_find(wad->index, name, type);
+}
+
 /*
  * wad_find
  */
 
 void *wad_find(wad_t *wad, const char *search, int *size)
 {
-	/* variables */
-	int i;
-
-	/* search */
-	for (i = 0; i < wad->header.num_lumps; i++)
-	{
-		if (strcmp(search, wad->lumps[i].name) == 0)
-		{
-			if (size) *size = wad->lumps[i].len_data;
-			return wad->lumps[i].data;
-		}
-	}
+	wad_lump_t *lump = wad_find_lump(wad, search, WAD_ANY_TYPE);
 
-	/* failure */
-	if (size) *size = 0;
-	return NULL;
+	if (size) *size = lump ? lump->len_data : 0;
+	return lump ? wad_lump_data(wad, lump) : NULL;
 }
@@ -22,6 +22,19 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#ifndef _WAD_H_
+#define _WAD_H_
+
+/* file */
+#include "file.h"
+
+/* wad_open flags */
+#define WAD_MAP 1 /* lump data points into a mapping of the file */
+#define WAD_LAZY 2 /* lump data is read on first access */
+
+/* matches a lump of any type */
+#define WAD_ANY_TYPE (-1)
+
 /* wad header */
 typedef struct
 {
@@ -40,14 +53,36 @@ typedef struct
 	void *data;
 } wad_lump_t;
 
+/* lump directory index */
+typedef struct
+{
+	struct wad_slot_s *slots;
+	int num_slots;
+	int num_lumps;
+} wad_index_t;
+
 /* wad structure */
 typedef struct
 {
 	wad_header_t header;
 	wad_lump_t *lumps;
+	wad_index_t *index;
+	file_t *file;
+	struct wad_lazy_s *lazy;
 } wad_t;
 
 /* function prototypes */
+wad_t *wad_open(const char *filename, int flags);
 wad_t *wad_read(const char *filename);
 void wad_free(wad_t *wad);
 void *wad_find(wad_t *wad, const char *search, int *size);
+wad_lump_t *wad_find_lump(wad_t *wad, const char *name, int type);
+void *wad_lump_data(wad_t *wad, wad_lump_t *lump);
+void wad_set_budget(wad_t *wad, size_t budget);
+wad_index_t *wad_index_create(int num_lumps);
+int wad_index_add(wad_index_t *index, wad_lump_t *lump, int replace);
+int wad_index_add_wad(wad_index_t *index, wad_t *wad, int replace);
+wad_lump_t *wad_index_find(const wad_index_t *index, const char *name, int type);
+void wad_index_free(wad_index_t *index);
+
+#endif /* _WAD_H_ */
@@ -43,6 +43,16 @@ SOFTWARE.
 /* glprey */
 #include "wad.h"
 #include "mip.h"
+#include "palette.h"
+
+/*
+ *
+ * globals
+ *
+ */
+
+/* 4 to write rgba with the keyed index transparent */
+int channels = 3;
 
 /*
  *
@@ -57,7 +67,7 @@ SOFTWARE.
 void write_palette(wad_lump_t *lump)
 {
 	char filename[16];
-	snprintf(filename, 16, "%s.png", lump->name);
+	snprintf(filename, 16, "%.8s.png", lump->name);
 	stbi_write_png(filename, 16, 16, 3, lump->data, 16 * 3);
 	printf("successfully wrote %s\n", filename);
 }
@@ -66,32 +76,25 @@ void write_palette(wad_lump_t *lump)
  * write_colormap
  */
 
-void write_colormap(wad_lump_t *lump, uint8_t *palette)
+void write_colormap(wad_lump_t *lump, palette_t *palette)
 {
 	/* variables */
 	char filename[16];
 	uint8_t *colormap;
 	uint8_t *pixels;
 	int num_pixels;
-	int i;
 
 	/* get ptr */
 	colormap = (uint8_t *)lump->data + 8;
 
-	/* create 24 bit version */
+	/* create 24 or 32 bit version */
 	num_pixels = 256 * 32;
-	pixels = malloc(num_pixels * 3);
-	for (i = 0; i < num_pixels; i++)
-	{
-		uint8_t *entry = &((uint8_t *)palette)[colormap[i] * 3];
-		pixels[i * 3] = *(entry);
-		pixels[(i * 3) + 1] = *(entry + 1);
-		pixels[(i * 3) + 2] = *(entry + 2);
-	}
+	pixels = malloc(num_pixels * channels);
+	palette_expand(palette, colormap, pixels, num_pixels, channels);
 
 	/* write file */
-	snprintf(filename, 16, "%s.png", lump->name);
-	stbi_write_png(filename, 256, 32, 3, pixels, 256 * 3);
+	snprintf(filename, 16, "%.8s.png", lump->name);
+	stbi_write_png(filename, 256, 32, channels, pixels, 256 * channels);
 
 	/* talk to you */
 	printf("successfully wrote %s\n", filename);
@@ -104,31 +107,29 @@ void write_colormap(wad_lump_t *lump, uint8_t *palette)
  * write_mip
  */
 
-void write_mip(wad_lump_t *lump, uint8_t *palette)
+void write_mip(wad_lump_t *lump, palette_t *palette)
 {
 	mip_t *mip;
 	int num_pixels;
 	char filename[16];
 	uint8_t *pixels;
-	int i;
 
 	/* get miptex */
-	mip = mip_from_buffer(lump->data, lump->len_data);
-	num_pixels = mip->header.width * mip->header.height;
-
-	/* create 24 bit version */
-	pixels = malloc(num_pixels * 3);
-	for (i = 0; i < num_pixels; i++)
+	mip = mip_view(lump->data, lump->len_data);
+	if (mip == NULL)
 	{
-		uint8_t *entry = &((uint8_t *)palette)[mip->entries[0].pixels[i] * 3];
-		pixels[i * 3] = *(entry);
-		pixels[(i * 3) + 1] = *(entry + 1);
-		pixels[(i * 3) + 2] = *(entry + 2);
+		printf("error: failed to read mip %.8s\n", lump->name);
+		return;
 	}
+	num_pixels = mip->header.width * mip->header.height;
+
+	/* create 24 or 32 bit version */
+	pixels = malloc(num_pixels * channels);
+	palette_expand(palette, mip->entries[0].pixels, pixels, num_pixels, channels);
 
 	/* save image */
-	snprintf(filename, 16, "%s.png", lump->name);
-	stbi_write_png(filename, mip->header.width, mip->header.height, 3, pixels, mip->header.width * 3);
+	snprintf(filename, 16, "%.8s.png", lump->name);
+	stbi_write_png(filename, mip->header.width, mip->header.height, channels, pixels, mip->header.width * channels);
 
 	/* talk to you */
 	printf("successfully wrote %s\n", filename);
@@ -138,6 +139,32 @@ void write_mip(wad_lump_t *lump, uint8_t *palette)
 	mip_free(mip);
 }
 
+/*
+ * write_lump
+ */
+
+void write_lump(wad_lump_t *lump, palette_t *palette)
+{
+	switch (lump->type)
+	{
+		case 8:
+			write_palette(lump);
+			break;
+
+		case 11:
+			write_mip(lump, palette);
+			break;
+
+		case 17:
+			write_colormap(lump, palette);
+			break;
+
+		default:
+			printf("lump %.8s has unsupported type %d\n", lump->name, lump->type);
+			break;
+	}
+}
+
 /*
  * main
  */
@@ -147,26 +174,66 @@ int main(int argc, char *argv[])
 	/* variables */
 	wad_t *wad;
 	uint8_t *palette;
+	palette_t expanded;
+	const char *filename = NULL;
+	char **names;
+	int num_names = 0;
+	int list = 0;
+	int key = -1;
 	int i;
 
-	/* read wad */
-	if (argc > 1)
+	names = calloc(argc, sizeof(char *));
+	if (names == NULL)
 	{
-		wad = wad_read(argv[1]);
-		if (!wad)
-		{
-			printf("error: failed to open %s\n", argv[1]);
-			return 1;
-		}
+		printf("error: failed malloc\n");
+		return 1;
 	}
-	else
+
+	/* check options */
+	for (i = 1; i < argc; i++)
 	{
-		wad = wad_read("MACT.WAD");
-		if (!wad)
+		/* write rgba, with this index transparent */
+		if (strcmp(argv[i], "--alpha") == 0 && i + 1 < argc)
+		{
+			key = atoi(argv[++i]);
+			channels = 4;
+			continue;
+		}
+
+		/* only print the directory */
+		if (strcmp(argv[i], "--list") == 0)
 		{
-			printf("error: failed to open MACT.WAD\n");
-			return 1;
+			list = 1;
+			continue;
 		}
+
+		/* first is the wad, the rest are lumps to write */
+		if (filename == NULL)
+			filename = argv[i];
+		else
+			names[num_names++] = argv[i];
+	}
+
+	if (filename == NULL)
+		filename = "MACT.WAD";
+
+	/* read wad, only touching the lumps we need when picking a few */
+	wad = wad_open(filename, list || num_names ? WAD_LAZY : WAD_MAP);
+	if (!wad)
+	{
+		printf("error: failed to open %s\n", filename);
+		return 1;
+	}
+
+	/* list lumps */
+	if (list)
+	{
+		for (i = 0; i < wad->header.num_lumps; i++)
+			printf("%-8.8s %3d %8d\n", wad->lumps[i].name, wad->lumps[i].type, wad->lumps[i].len_data);
+
+		wad_free(wad);
+		free(names);
+		return 0;
 	}
 
 	/* get palette */
@@ -176,32 +243,29 @@ int main(int argc, char *argv[])
 		printf("error: wad does not contain PAL lump\n");
 		return 1;
 	}
+	palette_init(&expanded, palette, key);
 
-	/* read lumps */
-	for (i = 0; i < wad->header.num_lumps; i++)
+	/* write the named lumps */
+	for (i = 0; i < num_names; i++)
 	{
-		switch (wad->lumps[i].type)
-		{
-			case 8:
-				write_palette(&wad->lumps[i]);
-				break;
-
-			case 11:
-				write_mip(&wad->lumps[i], palette);
-				break;
-
-			case 17:
-				write_colormap(&wad->lumps[i], palette);
-				break;
+		wad_lump_t *lump = wad_find_lump(wad, names[i], WAD_ANY_TYPE);
 
-			default:
-				printf("lump %s has unsupported type %d\n", wad->lumps[i].name, wad->lumps[i].type);
-				break;
+		if (lump == NULL || wad_lump_data(wad, lump) == NULL)
+		{
+			printf("error: couldn't read lump %s\n", names[i]);
+			continue;
 		}
+
+		write_lump(lump, &expanded);
 	}
 
+	/* or all of them */
+	for (i = 0; i < wad->header.num_lumps && !num_names; i++)
+		write_lump(&wad->lumps[i], &expanded);
+
 	/* free memory */
 	wad_free(wad);
+	free(names);
 
 	/* return success */
 	return 0;